@@ -0,0 +1,151 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+#include "argvbuilder.h"
+
+namespace vlofgren {
+
+ArgvBuilder::ArgvBuilder() {}
+
+void ArgvBuilder::clear() {
+	fbuffer.clear();
+	foffsets.clear();
+}
+
+ArgvBuilder& ArgvBuilder::add(const char* argument) {
+	foffsets.push_back(fbuffer.size());
+	fbuffer.insert(fbuffer.end(), argument, argument + strlen(argument) + 1);
+	return *this;
+}
+
+ArgvBuilder& ArgvBuilder::add(const string& argument) {
+	foffsets.push_back(fbuffer.size());
+	fbuffer.insert(fbuffer.end(), argument.begin(), argument.end());
+	fbuffer.push_back('\0');
+	return *this;
+}
+
+void ArgvBuilder::addOption(const Parameter& p, const string* value) {
+	foffsets.push_back(fbuffer.size());
+
+	if(p.longOption().empty()) {
+		fbuffer.push_back('-');
+		fbuffer.push_back(p.shortOption());
+
+		/* -o alone would take the next element as its argument, so an
+		 * empty one is given as an element of its own */
+		if(value && value->empty()) {
+			fbuffer.push_back('\0');
+			foffsets.push_back(fbuffer.size());
+		}
+	} else {
+		fbuffer.push_back('-');
+		fbuffer.push_back('-');
+		fbuffer.insert(fbuffer.end(), p.longOption().begin(), p.longOption().end());
+		if(value) fbuffer.push_back('=');
+	}
+
+	if(value) fbuffer.insert(fbuffer.end(), value->begin(), value->end());
+	fbuffer.push_back('\0');
+}
+
+const ArgvBuilder::Override* ArgvBuilder::findOverride(const Parameter& p) const {
+	for(vector<Override>::const_iterator i = foverrides.begin(); i != foverrides.end(); i++) {
+		if(i->parameter == &p) return &*i;
+	}
+	return NULL;
+}
+
+ArgvBuilder& ArgvBuilder::addParameter(const Parameter& p) {
+	const Override* o = findOverride(p);
+
+	if(o) {
+		if(o->omit) return *this;
+		addOption(p, p.takesArgument() ? &o->value : NULL);
+		return *this;
+	}
+
+	if(!p.takesArgument()) {
+		addOption(p, NULL);
+		return *this;
+	}
+
+	ftext.clear();
+	if(!p.formatArgument(ftext)) {
+		throw logic_error("--" + p.longOption() + ": value can not be written as an argument");
+	}
+	addOption(p, &ftext);
+	return *this;
+}
+
+ArgvBuilder& ArgvBuilder::addParameters(const OptionsParser& parser, bool includeDefaults) {
+	const vector<Parameter*>& ordered = parser.getParameters().ordered();
+
+	for(vector<Parameter*>::const_iterator i = ordered.begin(); i != ordered.end(); i++) {
+		const Override* o = findOverride(**i);
+
+		if(o || parser.wasGiven(**i) || (includeDefaults && (*i)->hasDefault())) {
+			addParameter(**i);
+		}
+	}
+	return *this;
+}
+
+ArgvBuilder& ArgvBuilder::addFiles(const vector<string>& files) {
+	for(vector<string>::const_iterator i = files.begin(); i != files.end(); i++) {
+		if(!i->empty() && (*i)[0] == '-') {
+			add("--");
+			break;
+		}
+	}
+
+	for(vector<string>::const_iterator i = files.begin(); i != files.end(); i++) add(*i);
+	return *this;
+}
+
+void ArgvBuilder::override(const Parameter& p, const char* value) {
+	Override* o = const_cast<Override*>(findOverride(p));
+	if(!o) {
+		foverrides.push_back(Override());
+		o = &foverrides.back();
+		o->parameter = &p;
+	}
+
+	o->omit = (value == NULL);
+	o->value.assign(value ? value : "");
+}
+
+void ArgvBuilder::clearOverrides() {
+	foverrides.clear();
+}
+
+/* The pointers are only computed here, since the buffer may move while arguments are added */
+char* const* ArgvBuilder::argv() {
+	fpointers.resize(foffsets.size() + 1);
+	for(size_t i = 0; i < foffsets.size(); i++) fpointers[i] = &fbuffer[foffsets[i]];
+	fpointers[foffsets.size()] = NULL;
+
+	return &fpointers[0];
+}
+
+int ArgvBuilder::argc() const {
+	return foffsets.size();
+}
+
+} //namespace
@@ -0,0 +1,111 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "getoptpp.h"
+
+#ifndef GETOPTPP_ARGVBUILDER_H
+#define GETOPTPP_ARGVBUILDER_H
+
+namespace vlofgren {
+
+/** Builds command lines out of parameter values, e.g. for spawning workers
+ * with the options of the parent.
+ *
+ * The arguments are laid out in one contiguous buffer, with an array of
+ * pointers to them, ready for execv() or posix_spawn(). clear() keeps both,
+ * so a builder that is reused from child to child stops allocating once it
+ * has seen the longest command line.
+ *
+ * Parameters are written as --option=value (or -ovalue, for parameters
+ * without a long name), which OptionsParser::parse() reads back to the same
+ * value whatever characters the value has. An empty value of a parameter
+ * without a long name is written as -o followed by an empty argument.
+ *
+ *	ArgvBuilder args;
+ *	args.override(threads, "1");
+ *	for(...) {
+ *		args.clear();
+ *		args.add("worker").addParameters(parser).add(job);
+ *		posix_spawn(&pid, path, NULL, NULL, args.argv(), environ);
+ *	}
+ */
+class GETOPTPP_API ArgvBuilder {
+public:
+	ArgvBuilder();
+
+	/** Start a new command line. Overrides are kept. */
+	void clear();
+
+	/** Append an argument as is */
+	ArgvBuilder& add(const char* argument);
+	ArgvBuilder& add(const string& argument);
+
+	/** Append a parameter with its current value (or its override).
+	 *
+	 * @throw logic_error if the parameter's value has no text form
+	 */
+	ArgvBuilder& addParameter(const Parameter& p);
+
+	/** Append every parameter given on the command line of the parser's last parse,
+	 * in the order they were added to the ParameterSet.
+	 *
+	 * @param includeDefaults Also append parameters that only have a default value.
+	 */
+	ArgvBuilder& addParameters(const OptionsParser& parser, bool includeDefaults = false);
+
+	/** Append files, after a "--" if any of them could be taken for an option */
+	ArgvBuilder& addFiles(const vector<string>& files);
+
+	/** Use another value for the parameter in addParameter()/addParameters().
+	 *
+	 * @param value The value, "" for a switch, or NULL to leave the parameter out.
+	 */
+	void override(const Parameter& p, const char* value);
+
+	/** Forget all overrides */
+	void clearOverrides();
+
+	/** The NULL terminated argument vector. Valid until the builder is next changed. */
+	char* const* argv();
+
+	int argc() const;
+private:
+	struct Override {
+		const Parameter* parameter;
+		bool omit;
+		string value;
+	};
+
+	const Override* findOverride(const Parameter& p) const;
+
+	/** Append the option of p, with value as its argument unless it is NULL */
+	void addOption(const Parameter& p, const string* value);
+
+	vector<char> fbuffer;
+	vector<size_t> foffsets;
+	vector<char*> fpointers;
+
+	vector<Override> foverrides;
+
+	/** Scratch space for formatting values */
+	string ftext;
+};
+
+} //namespace
+
+#endif
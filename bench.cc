@@ -0,0 +1,186 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+/*
+ * Parser benchmark
+ *
+ * Times a few typical workloads and prints one "name ns/op" line for each,
+ * which is what `make compare` reads. It also serves as the training run of
+ * the profile-guided build, so the workloads should stay representative.
+ *
+ *	bench [scale]	multiplies the number of iterations by scale
+ */
+
+#include "getoptpp.h"
+#include "units.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace vlofgren;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+enum Mode { FAST, SAFE, DEBUG };
+
+static const EnumParameter<Mode>::Value modes[] = {
+	{ "fast", FAST }, { "safe", SAFE }, { "debug", DEBUG }
+};
+
+/* Keeps the compiler from optimizing the work away */
+static volatile size_t sink;
+
+template<typename F>
+static void run(const char* name, long iterations, F f) {
+	f(); // warm up
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(long i = 0; i < iterations; i++) f();
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	double ns = std::chrono::duration<double, std::nano>(end - start).count();
+	printf("%-10s %10.1f ns/op\n", name, ns / iterations);
+}
+
+/* A command line like most tools get: a few options of each kind, and some files */
+static void typical(long iterations) {
+	OptionsParser optp("typical");
+	ParameterSet& ps = optp.getParameters();
+
+	ps.add<SwitchParameter>('v', "verbose", "Verbose");
+	ps.add<SwitchParameter>('x', "extract", "Extract");
+	ps.add<StringParameter>('f', "file", "Archive");
+	ps.add<StringParameter>('o', "output", "Output");
+	ps.add<IntParameter>('n', "count", "Count");
+	ps.add<DoubleParameter>('r', "ratio", "Ratio");
+	ps.add<SizeParameter>('s', "size", "Size");
+	ps.add<DurationParameter>('t', "timeout", "Timeout");
+	ps.add<EnumParameter<Mode> >('m', "mode", "Mode").setValues(modes);
+
+	const char* argv[] = {
+		"typical", "-xvf", "archive.tar", "--count=42", "-o", "out.txt",
+		"--ratio=0.75", "--size=64M", "-t", "1.5s", "--mode=safe", "a.c", "b.c", "c.c"
+	};
+	const int argc = sizeof(argv) / sizeof(argv[0]);
+
+	run("typical", iterations, [&]() {
+		optp.reset();
+		optp.parse(argc, argv);
+		sink = optp.getFiles().size();
+	});
+}
+
+/* Many parameters, most of them given by their long form */
+static void wide(long iterations) {
+	OptionsParser optp("wide");
+	ParameterSet& ps = optp.getParameters();
+
+	static char names[256][16];
+	static char arguments[128][24];
+	const char* argv[129] = { "wide" };
+
+	for(int i = 0; i < 256; i++) {
+		snprintf(names[i], sizeof(names[i]), "option-%03d", i);
+		ps.add<LongParameter>(0, names[i], "An option");
+	}
+	for(int i = 0; i < 128; i++) {
+		snprintf(arguments[i], sizeof(arguments[i]), "--option-%03d=%d", i * 2, i);
+		argv[i + 1] = arguments[i];
+	}
+
+	run("wide", iterations / 100, [&]() {
+		optp.reset();
+		optp.parse(129, argv);
+		sink = optp.getFiles().size();
+	});
+}
+
+/* Garbage, collecting every error */
+static void errors(long iterations) {
+	OptionsParser optp("errors");
+	ParameterSet& ps = optp.getParameters();
+
+	ps.add<IntParameter>('n', "count", "Count");
+	ps.add<SwitchParameter>('v', "verbose", "Verbose");
+	ps.add<EnumParameter<Mode> >('m', "mode", "Mode").setValues(modes);
+
+	const char* argv[] = {
+		"errors", "--count=many", "--colour", "-q", "--mode=turbo", "--verbose=yes", "-n"
+	};
+	const int argc = sizeof(argv) / sizeof(argv[0]);
+	ParseErrors found;
+
+	run("errors", iterations / 10, [&]() {
+		optp.reset();
+		sink = optp.parse(argc, argv, found);
+	});
+}
+
+/* Saving and restoring the parsed state */
+static void snapshot(long iterations) {
+	OptionsParser optp("snapshot");
+	ParameterSet& ps = optp.getParameters();
+
+	ps.add<StringParameter>('o', "output", "Output");
+	ps.add<IntParameter>('n', "count", "Count");
+	ps.add<SizeParameter>('s', "size", "Size");
+
+	const char* argv[] = { "snapshot", "-o", "out.txt", "-n", "7", "--size=1G", "a.c" };
+	optp.parse(sizeof(argv) / sizeof(argv[0]), argv);
+
+	string data;
+	run("snapshot", iterations, [&]() {
+		data.clear();
+		optp.snapshot(data);
+		optp.restore(data.data(), data.length());
+	});
+}
+
+/* Rendering the help screen */
+static void usage(long iterations) {
+	OptionsParser optp("usage");
+	ParameterSet& ps = optp.getParameters();
+
+	ps.add<SwitchParameter>('v', "verbose", "Print more about what is going on");
+	ps.add<StringParameter>('o', "output", "Where to write the result");
+	ps.add<IntParameter>('n', "count", "How many times to do it");
+	ps.add<EnumParameter<Mode> >('m', "mode", "How to do it").setValues(modes);
+
+	static char buffer[4096];
+	run("usage", iterations / 10, [&]() {
+		BufferSink out(buffer, sizeof(buffer));
+		optp.usage(out);
+		sink = out.length();
+	});
+}
+
+int main(int argc, const char* argv[]) {
+	long scale = argc > 1 ? atol(argv[1]) : 1;
+	long iterations = 100000 * (scale > 0 ? scale : 1);
+
+	typical(iterations);
+	wide(iterations);
+	errors(iterations);
+	snapshot(iterations);
+	usage(iterations);
+
+	return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,1506 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Behaviour checks
+ *
+ * Each check parses a command line, or drives one of the library's
+ * components, and compares the outcome with what it should be. Run by
+ * `make check`, also against libgetoptpp.so.
+ *
+ *	check [name]	runs only the checks whose name starts with name
+ *
+ * Exits with EXIT_FAILURE if any check failed.
+ */
+
+#include "getoptpp.h"
+#include "argvbuilder.h"
+#include "glob.h"
+#include "incremental.h"
+#include "intern.h"
+#include "live.h"
+#include "registry.h"
+#include "units.h"
+#include "validators.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <initializer_list>
+#include <thread>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace vlofgren;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+static int failures = 0;
+static const char* current = "";
+
+#define CHECK(condition) \
+	do { \
+		if(!(condition)) { \
+			printf("%s:%d: %s: failed: %s\n", __FILE__, __LINE__, current, #condition); \
+			failures++; \
+		} \
+	} while(0)
+
+/** Parse the given arguments, with "check" as argv[0] */
+static void parse(OptionsParser& optp, std::initializer_list<const char*> arguments) {
+	vector<const char*> argv(1, "check");
+	argv.insert(argv.end(), arguments.begin(), arguments.end());
+	optp.parse(argv.size(), &argv[0]);
+}
+
+/** parse(), collecting the errors */
+static bool parse(OptionsParser& optp, std::initializer_list<const char*> arguments, ParseErrors& errors) {
+	vector<const char*> argv(1, "check");
+	argv.insert(argv.end(), arguments.begin(), arguments.end());
+	return optp.parse(argv.size(), &argv[0], errors);
+}
+
+/** The state of every parameter of a parser after a parse, as text */
+static string outcome(const OptionsParser& optp) {
+	string out;
+	const vector<Parameter*>& ordered = optp.getParameters().ordered();
+	for(size_t i = 0; i < ordered.size(); i++) {
+		out += "--" + ordered[i]->longOption();
+		out += ordered[i]->isSet() ? " set" : " unset";
+		out += optp.wasGiven(*ordered[i]) ? " given " : " not-given ";
+		ordered[i]->formatArgument(out);
+		out += '\n';
+	}
+	return out;
+}
+
+/** The errors of a parse, as text */
+static string outcome(const ParseErrors& errors) {
+	string out;
+	for(size_t i = 0; i < errors.size(); i++) {
+		char position[32];
+		snprintf(position, sizeof(position), "%d %d ", (int) errors[i].kind, errors[i].position);
+		out += position + errors[i].message + '\n';
+	}
+	return out;
+}
+
+/*
+ *
+ * Registered options
+ *
+ */
+
+GETOPTPP_OPTION(IntParameter, checkThreads, 'T', "threads", 4, "Worker threads");
+GETOPTPP_OPTION(StringParameter, checkName, 0, "name", "unnamed", "Name of the run");
+GETOPTPP_SWITCH(checkQuiet, 'q', "quiet", "Print less");
+
+static void registry() {
+	CHECK(checkThreads == 4);
+	CHECK(strcmp(checkName, "unnamed") == 0);
+	CHECK(!checkQuiet);
+
+	const char* longName = "a name too long to be held inside a string object";
+	{
+		OptionsParser optp("check");
+		optp.addRegisteredOptions();
+		optp.addRegisteredOptions();
+
+		ParameterSet& ps = optp.getParameters();
+		CHECK(ps.size() == 3);
+		CHECK(ps['T'].longOption() == "threads");
+
+		parse(optp, { "--threads=8", "-q", "--name=nightly" });
+		CHECK(checkThreads == 8);
+		CHECK(strcmp(checkName, "nightly") == 0);
+		CHECK(checkQuiet);
+		CHECK(ps["threads"].get<int>() == 8);
+
+		/* The string stays valid as the value changes */
+		const char* nightly = checkName;
+		optp.reset();
+		CHECK(checkThreads == 4);
+		CHECK(strcmp(checkName, "unnamed") == 0);
+		CHECK(!checkQuiet);
+		parse(optp, { ("--name=" + string(longName)).c_str() });
+		CHECK(strcmp(nightly, "nightly") == 0);
+
+		/* A parser that doesn't ask for them doesn't get them, and only one may */
+		OptionsParser other("check");
+		CHECK(other.getParameters().size() == 0);
+
+		bool thrown = false;
+		try {
+			other.addRegisteredOptions();
+		} catch(logic_error& e) {
+			thrown = true;
+		}
+		CHECK(thrown && other.getParameters().size() == 0);
+	}
+
+	/* They are free again once their parser is gone, which the string outlives */
+	CHECK(strcmp(checkName, longName) == 0);
+	OptionsParser again("check");
+	again.addRegisteredOptions();
+	CHECK(again.getParameters().size() == 3);
+}
+
+/*
+ *
+ * Parameters
+ *
+ */
+
+static void namePool() {
+	const char* description = "A description long enough to be held outside a string object";
+	OptionsParser first("check"), second("check");
+	Parameter& a = first.getParameters().add<IntParameter>('a', "shared-name", description);
+	Parameter& b = second.getParameters().add<StringParameter>('b', "shared-name", description);
+	Parameter& c = second.getParameters().add<SwitchParameter>('c', "other-name", description);
+
+	/* Equal texts are held once, by every parser */
+	CHECK(&a.longOption() == &b.longOption());
+	CHECK(&a.description() == &b.description() && &b.description() == &c.description());
+	CHECK(b.longOption() == "shared-name" && c.longOption() == "other-name");
+	CHECK(c.description() == description);
+
+	/* and counted once per parser */
+	MemoryUsage one = first.memoryUsage(), two = second.memoryUsage();
+	CHECK(one.descriptions > strlen(description) && two.descriptions == one.descriptions);
+	CHECK(two.names > one.names);
+
+	Parameter& unnamed = first.getParameters().add<IntParameter>('u', "", "");
+	CHECK(unnamed.longOption().empty() && unnamed.description().empty());
+}
+
+/*
+ *
+ * Enumerations
+ *
+ */
+
+enum Shape { SQUARE, CIRCLE, TRIANGLE };
+
+static const EnumParameter<Shape>::Value shapes[] = {
+	{ "square", SQUARE }, { "Circle", CIRCLE }, { "TRIANGLE", TRIANGLE }
+};
+
+static void enumMatching() {
+	OptionsParser optp("check");
+	ParameterSet& ps = optp.getParameters();
+	ps.add<EnumParameter<Shape> >('s', "shape", "").setValues(shapes);
+	ps.add<EnumParameter<Shape> >('i', "ignore-case", "").setValues(shapes, true);
+
+	parse(optp, { "--shape=Circle", "--ignore-case=circle" });
+	CHECK(ps['s'].get<Shape>() == CIRCLE && ps['i'].get<Shape>() == CIRCLE);
+
+	parse(optp, { "-iSqUaRe" });
+	CHECK(ps['i'].get<Shape>() == SQUARE);
+
+	/* Case is only ignored when asked for, and the whole argument must match */
+	ParseErrors errors;
+	CHECK(!parse(optp, { "--shape=circle", "--ignore-case=squar", "-itriangle ", "-sTRIANGLE" }, errors));
+	CHECK(outcome(errors) ==
+		"4 1 --shape: Invalid argument \"circle\"\n"
+		"4 2 --ignore-case: Invalid argument \"squar\"\n"
+		"4 3 Invalid argument \"triangle \"\n");
+	CHECK(ps['s'].get<Shape>() == TRIANGLE && !ps['i'].isSet());
+}
+
+static void enumDuplicates() {
+	EnumMatcher matcher;
+	bool thrown = false;
+	try {
+		matcher.build({ "one", "two", "one" }, false);
+	} catch(logic_error& e) {
+		thrown = string(e.what()) == "EnumMatcher: duplicate name one";
+	}
+	CHECK(thrown);
+
+	/* Names differing in case are only duplicates when case is ignored */
+	matcher.build({ "One", "one" }, false);
+	CHECK(matcher.find("One", 3) == 0 && matcher.find("one", 3) == 1 && matcher.find("ONE", 3) == -1);
+
+	thrown = false;
+	try {
+		matcher.build({ "One", "two", "oNE" }, true);
+	} catch(logic_error& e) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+static void enumPerfectHash() {
+	/* Enough names that buckets collide, and displacements must be searched for */
+	vector<string> texts;
+	for(int i = 0; i < 5000; i++) texts.push_back("value-" + to_string(i * 7) + ";");
+
+	vector<const char*> names;
+	for(size_t i = 0; i < texts.size(); i++) names.push_back(texts[i].c_str());
+
+	for(int ignoreCase = 0; ignoreCase < 2; ignoreCase++) {
+		EnumMatcher matcher;
+		matcher.build(names, ignoreCase);
+
+		size_t found = 0, missed = 0;
+		for(size_t i = 0; i < texts.size(); i++) {
+			string upper = "VALUE" + texts[i].substr(5);
+			if(matcher.find(texts[i].data(), texts[i].length()) == (long) i) found++;
+			if(matcher.find(upper.data(), upper.length()) == (ignoreCase ? (long) i : -1)) found++;
+
+			/* Values between the names, and the names cut short */
+			string between = "value-" + to_string(i * 7 + 3) + ";";
+			if(matcher.find(between.data(), between.length()) == -1) missed++;
+			if(matcher.find(texts[i].data(), texts[i].length() - 1) == -1) missed++;
+		}
+		CHECK(found == 2 * texts.size());
+		CHECK(missed == 2 * texts.size());
+		CHECK(matcher.memoryUsage() < 100 * texts.size());
+	}
+}
+
+/*
+ *
+ * Parsing and collecting errors
+ *
+ */
+
+static void reparse() {
+	OptionsParser optp("check");
+	ParameterSet& ps = optp.getParameters();
+	ps.add<IntParameter>('n', "number", "").setDefault(3);
+	ps.add<SwitchParameter>('v', "verbose", "");
+
+	parse(optp, { "-n", "5", "-v", "a", "b" });
+	CHECK(ps['n'].get<int>() == 5);
+
+	/* Each parse starts over, rather than finding -n given twice */
+	parse(optp, { "-n7", "c" });
+	CHECK(ps['n'].get<int>() == 7);
+	CHECK(!ps['v'].isSet());
+	CHECK(optp.getFiles() == vector<string>(1, "c"));
+
+	parse(optp, {});
+	CHECK(ps['n'].get<int>() == 3);
+	CHECK(!optp.wasGiven(ps['n']));
+	CHECK(optp.fileCount() == 0);
+}
+
+enum Colour { RED, GREEN };
+
+static const EnumParameter<Colour>::Value colours[] = { { "red", RED }, { "green", GREEN } };
+
+/** A parameter of each type that reports rejected arguments without throwing */
+static void addTyped(OptionsParser& optp) {
+	ParameterSet& ps = optp.getParameters();
+	ps.add<IntParameter>('i', "int", "");
+	ps.add<LongParameter>('l', "long", "");
+	ps.add<DoubleParameter>('d', "double", "");
+	ps.add<SizeParameter>('z', "size", "");
+	ps.add<DurationParameter>('t', "time", "");
+	ps.add<RangeSetParameter>('r', "ranges", "");
+	ps.add<EnumParameter<Colour> >('c', "colour", "").setValues(colours);
+	ps.add<ValidatedStringParameter>('x', "hex", "").validator().pattern("[0-9a-f]+");
+}
+
+static void collectedErrors() {
+	const vector<vector<const char*> > bad = {
+		{ "-ix" }, { "--long=1.5" }, { "-d", "" }, { "--size=4Q" }, { "-t5" },
+		{ "--ranges=3-1" }, { "-cblue" }, { "--hex=12g" }
+	};
+
+	/* Collected, the errors are the ones a throwing parse gives one at a time */
+	OptionsParser optp("check");
+	addTyped(optp);
+
+	vector<const char*> argv(1, "check");
+	vector<int> positions;
+	for(size_t i = 0; i < bad.size(); i++) {
+		positions.push_back(argv.size());
+		argv.insert(argv.end(), bad[i].begin(), bad[i].end());
+	}
+
+	ParseErrors errors;
+	CHECK(!optp.parse(argv.size(), &argv[0], errors));
+	CHECK(errors.size() == bad.size());
+
+	for(size_t i = 0; i < errors.size() && i < bad.size(); i++) {
+		vector<const char*> single(1, "check");
+		single.insert(single.end(), bad[i].begin(), bad[i].end());
+
+		string what;
+		OptionsParser thrower("check");
+		addTyped(thrower);
+		try { thrower.parse(single.size(), &single[0]); } catch(Parameter::ParameterRejected& e) { what = e.what(); }
+
+		CHECK(errors[i].kind == ParseError::BAD_VALUE);
+		CHECK(errors[i].position == positions[i]);
+		CHECK(!what.empty() && errors[i].message == what);
+		CHECK(!optp.wasGiven(*errors[i].parameter));
+	}
+}
+
+/** A switch given as +name, which only receive() can read */
+class PlusSwitch : public SwitchParameter {
+public:
+	PlusSwitch(char shortOption, const char* longOption, const char* description) :
+		SwitchParameter(shortOption, longOption, description) {}
+protected:
+	virtual bool receive(ParserState& state) GETOPTPP_THROW(ParameterRejected) {
+		if(state.get() != "+" + longOption()) return SwitchParameter::receive(state);
+		receiveSwitch();
+		return true;
+	}
+	virtual bool decodesShortOption() const { return false; }
+};
+
+static void shortClusters() {
+	OptionsParser optp("check");
+	ParameterSet& ps = optp.getParameters();
+	SwitchParameter& x = ps.add<SwitchParameter>('x', "extract", "");
+	SwitchParameter& v = ps.add<SwitchParameter>('v', "verbose", "");
+	StringParameter& f = ps.add<StringParameter>('f', "file", "");
+	PlusSwitch& plus = ps.add<PlusSwitch>('p', "plus", "");
+
+	parse(optp, { "-xvf", "archive", "a" });
+	CHECK(x.isSet() && v.isSet() && optp.wasGiven(f) && f.get<string>() == "archive");
+	CHECK(optp.getFiles() == vector<string>(1, "a"));
+
+	parse(optp, { "-xvfvalue", "a" });
+	CHECK(x.isSet() && v.isSet() && f.get<string>() == "value");
+	CHECK(optp.getFiles() == vector<string>(1, "a"));
+
+	/* An unknown letter stops the cluster */
+	string what;
+	try { parse(optp, { "-xqv" }); } catch(Parameter::ParameterRejected& e) { what = e.what(); }
+	CHECK(what == "Bad parameter: -q");
+
+	ParseErrors errors;
+	CHECK(!parse(optp, { "a", "-xqv" }, errors));
+	CHECK(outcome(errors) == std::to_string((int) ParseError::UNKNOWN_OPTION) + " 2 Bad parameter: -q\n");
+	CHECK(x.isSet() && !v.isSet());
+
+	/* The last option of the cluster needs an argument, and argv ends */
+	what = "";
+	try { parse(optp, { "-xvf" }); } catch(Parameter::ExpectedArgument& e) { what = e.what(); }
+	CHECK(what == "-f: expected an argument");
+
+	CHECK(!parse(optp, { "-xvf" }, errors));
+	CHECK(outcome(errors) == std::to_string((int) ParseError::MISSING_ARGUMENT) + " 1 -f: expected an argument\n");
+	CHECK(x.isSet() && v.isSet() && !optp.wasGiven(f));
+
+	/* A parameter that reads its own syntax still gets whole tokens */
+	parse(optp, { "+plus", "-x" });
+	CHECK(plus.isSet() && x.isSet() && optp.getFiles().empty());
+	parse(optp, { "-p" });
+	CHECK(plus.isSet());
+}
+
+/** Subclasses replacing validate(), which a collecting parse must call too */
+class EvenParameter : public IntParameter {
+public:
+	EvenParameter(char shortOption, const char *longOption, const char* description)
+		: IntParameter(shortOption, longOption, description) {}
+protected:
+	virtual int validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected) {
+		int value = IntParameter::validate(s);
+		if(value % 2) throw ParameterRejected("odd");
+		return value;
+	}
+};
+
+class StrictColourParameter : public EnumParameter<Colour> {
+public:
+	StrictColourParameter(char shortOption, const char *longOption, const char* description)
+		: EnumParameter<Colour>(shortOption, longOption, description) {}
+protected:
+	virtual Colour validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected) {
+		if(s != "green") throw ParameterRejected("not green");
+		return EnumParameter<Colour>::validate(s);
+	}
+};
+
+class NoDigitsParameter : public ValidatedStringParameter {
+public:
+	NoDigitsParameter(char shortOption, const char *longOption, const char* description)
+		: ValidatedStringParameter(shortOption, longOption, description) {}
+protected:
+	virtual string validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected) {
+		if(s.find_first_of("0123456789") != string::npos) throw ParameterRejected("digits");
+		return ValidatedStringParameter::validate(s);
+	}
+};
+
+static void overriddenValidation() {
+	OptionsParser optp("check");
+	ParameterSet& ps = optp.getParameters();
+	ps.add<EvenParameter>('e', "even", "");
+	ps.add<StrictColourParameter>('c', "colour", "").setValues(colours);
+	ps.add<NoDigitsParameter>('x', "hex", "").validator().pattern("[0-9a-f]+");
+
+	ParseErrors errors;
+	CHECK(!parse(optp, { "-e3", "-cred", "-x", "12", "-e", "x" }, errors));
+	CHECK(outcome(errors) ==
+		"4 1 odd\n"
+		"4 2 not green\n"
+		"4 3 digits\n"
+		"4 5 Expected int\n");
+
+	CHECK(parse(optp, { "-e4", "-cgreen", "-x", "ab" }, errors));
+	CHECK(ps['e'].get<int>() == 4 && ps['c'].get<Colour>() == GREEN && ps['x'].get<string>() == "ab");
+}
+
+/*
+ *
+ * Incremental parsing
+ *
+ */
+
+/** An event, as text */
+static string outcome(const ParseEvent& event) {
+	char position[16];
+	snprintf(position, sizeof(position), " %d", event.position);
+
+	switch(event.kind) {
+	case ParseEvent::OPTION:
+		return "option" + string(position) + " --" + event.parameter->longOption() + " " + event.value + "\n";
+	case ParseEvent::POSITIONAL:
+		return "positional" + string(position) + " " + event.value + "\n";
+	default:
+		return "error" + string(position) + " " + std::to_string((int) event.error.kind) + " " + event.error.message + "\n";
+	}
+}
+
+/** The events not polled yet, as text */
+static string polled(IncrementalParser& inc) {
+	string out;
+	ParseEvent event;
+	while(inc.poll(event)) out += outcome(event);
+	return out;
+}
+
+static void addIncremental(OptionsParser& optp) {
+	ParameterSet& ps = optp.getParameters();
+	Parameter& x = ps.add<SwitchParameter>('x', "extract", "");
+	ps.add<StringParameter>('o', "output", "");
+	Parameter& n = ps.add<IntParameter>('n', "number", "");
+	Parameter& q = ps.add<SwitchParameter>('q', "quiet", "");
+	n.setRequired();
+	ps.exclusive(ParameterGroup(x).add(q));
+}
+
+static void incrementalParsing() {
+	OptionsParser optp("check");
+	addIncremental(optp);
+	IncrementalParser inc(optp);
+
+	/* A cluster ending in -o waits for its argument */
+	inc.begin("check");
+	inc.feed("-xo");
+	CHECK(polled(inc) == "");
+	inc.feed("out");
+	CHECK(polled(inc) == "option 1 --extract \noption 1 --output out\n");
+	inc.feed("a");
+	inc.feed("--bogus");
+	inc.feed("--number=4");
+	CHECK(polled(inc) == "positional 3 a\nerror 4 0 Bad parameter: --bogus\noption 5 --number 4\n");
+	inc.feed("--");
+	inc.feed("-x");
+	CHECK(polled(inc) == "positional 7 -x\n");
+	CHECK(inc.ended());
+	inc.finish();
+	CHECK(polled(inc) == "");
+	CHECK(optp.getParameters()['o'].get<string>() == "out");
+	CHECK(optp.getFiles().size() == 2 && optp.getFiles()[1] == "-x");
+
+	/* A trailing -o, and the constraints, are reported by finish() */
+	inc.begin("check");
+	inc.feed("-xq");
+	inc.feed("-o");
+	CHECK(polled(inc) == "option 1 --extract \noption 1 --quiet \n");
+	inc.finish();
+	CHECK(polled(inc) ==
+			"error 2 " + std::to_string((int) ParseError::MISSING_ARGUMENT) + " -o: expected an argument\n" +
+			"error -1 " + std::to_string((int) ParseError::MISSING_REQUIRED) + " --number: required parameter not given\n" +
+			"error -1 " + std::to_string((int) ParseError::CONFLICTING_OPTIONS) + " --extract, --quiet: can not be given together\n");
+
+	/* The same tokens parsed at once give the same errors */
+	ParseErrors errors;
+	CHECK(!parse(optp, { "-xq", "-o" }, errors));
+	CHECK(errors.size() == 3 && errors[0].position == 2 && errors[2].kind == ParseError::CONFLICTING_OPTIONS);
+}
+
+#ifdef GETOPTPP_HAVE_GENERATOR
+#include <ranges>
+
+static void eventGenerator() {
+	OptionsParser optp("check");
+	addIncremental(optp);
+	IncrementalParser inc(optp);
+
+	vector<string> tokens = { "-xo", "out", "a", "--bogus", "-n", "4", "-o" };
+	string generated;
+	for(const ParseEvent& event : parseEvents(inc, "check", std::views::all(tokens))) generated += outcome(event);
+
+	inc.begin("check");
+	string fed;
+	for(size_t i = 0; i < tokens.size(); i++) {
+		inc.feed(tokens[i]);
+		fed += polled(inc);
+	}
+	inc.finish();
+	fed += polled(inc);
+
+	CHECK(generated == fed);
+	CHECK(generated.find("option 5 --number 4\n") != string::npos);
+	CHECK(generated.find(" -o: expected an argument\n") != string::npos);
+}
+#elif __cplusplus >= 202002L
+#error "C++20 without the generator of incremental.h"
+#endif
+
+/*
+ *
+ * Constraints
+ *
+ */
+
+/** The outcome of parsing arguments, thrown and collected: the kind, the
+ * message and the parameters involved, which must agree between the two */
+static string violation(OptionsParser& optp, std::initializer_list<const char*> arguments) {
+	string thrown;
+	try {
+		parse(optp, arguments);
+	} catch(Parameter::ConstraintViolation& e) {
+		thrown = string(dynamic_cast<Parameter::MissingRequired*>(&e) ? "missing " : "violated ") + e.what();
+		for(size_t i = 0; i < e.parameters().size(); i++) thrown += " " + e.parameters()[i]->longOption();
+	}
+
+	ParseErrors errors;
+	bool ok = parse(optp, arguments, errors);
+	CHECK(ok == thrown.empty());
+	CHECK(errors.size() == (ok ? 0 : 1));
+	if(ok || errors.size() != 1) return thrown;
+
+	CHECK(errors[0].position == -1);
+	CHECK(thrown.find(errors[0].message) != string::npos);
+	CHECK(errors[0].parameter && thrown.find(" " + errors[0].parameter->longOption()) != string::npos);
+
+	char kind[32];
+	snprintf(kind, sizeof(kind), "%d ", (int) errors[0].kind);
+	return kind + thrown;
+}
+
+static void constraints() {
+	/* More than 64 parameters, so that the groups span several words */
+	OptionsParser optp("check");
+	ParameterSet& ps = optp.getParameters();
+	vector<Parameter*> p;
+	for(int i = 0; i < 130; i++) {
+		char name[8];
+		snprintf(name, sizeof(name), "p%03d", i);
+		p.push_back(&ps.add<SwitchParameter>(0, name, ""));
+	}
+
+	p[1]->setRequired();
+	p[90]->setRequired();
+	ps.requireAny(ParameterGroup(*p[5]).add(*p[70]).add(*p[128]));
+	ps.exclusive(ParameterGroup(*p[10]).add(*p[75]).add(*p[129]));
+	ps.depends(ParameterGroup(*p[20]).add(*p[100]), ParameterGroup(*p[65]).add(*p[127]));
+
+	CHECK(violation(optp, { "--p001", "--p090", "--p070" }) == "");
+	CHECK(violation(optp, { "--p001", "--p090", "--p005", "--p128", "--p129", "--p100", "--p065", "--p127" }) == "");
+
+	char kind[8];
+	snprintf(kind, sizeof(kind), "%d ", (int) ParseError::MISSING_REQUIRED);
+	CHECK(violation(optp, { "--p070" }) ==
+			kind + string("missing --p001, --p090: required parameter not given p001 p090"));
+	CHECK(violation(optp, { "--p001", "--p090" }) ==
+			kind + string("missing --p005, --p070, --p128: one of these is required p005 p070 p128"));
+
+	snprintf(kind, sizeof(kind), "%d ", (int) ParseError::CONFLICTING_OPTIONS);
+	CHECK(violation(optp, { "--p001", "--p090", "--p070", "--p075", "--p010", "--p129" }) ==
+			kind + string("violated --p010, --p075, --p129: can not be given together p010 p075 p129"));
+	CHECK(violation(optp, { "--p001", "--p090", "--p070", "--p129", "--p010" }) ==
+			kind + string("violated --p010, --p129: can not be given together p010 p129"));
+
+	snprintf(kind, sizeof(kind), "%d ", (int) ParseError::MISSING_DEPENDENCY);
+	CHECK(violation(optp, { "--p001", "--p090", "--p070", "--p100", "--p065" }) ==
+			kind + string("violated --p100: requires --p127 p100 p127"));
+	CHECK(violation(optp, { "--p001", "--p090", "--p070", "--p020" }) ==
+			kind + string("violated --p020: requires --p065, --p127 p020 p065 p127"));
+
+	/* Collecting, every violation is reported */
+	ParseErrors errors;
+	CHECK(!parse(optp, { "--p010", "--p075", "--p100" }, errors));
+	CHECK(outcome(errors) ==
+			std::to_string((int) ParseError::MISSING_REQUIRED) + " -1 --p001, --p090: required parameter not given\n" +
+			std::to_string((int) ParseError::MISSING_REQUIRED) + " -1 --p005, --p070, --p128: one of these is required\n" +
+			std::to_string((int) ParseError::CONFLICTING_OPTIONS) + " -1 --p010, --p075: can not be given together\n" +
+			std::to_string((int) ParseError::MISSING_DEPENDENCY) + " -1 --p100: requires --p065, --p127\n");
+}
+
+/*
+ *
+ * Deferred validation
+ *
+ */
+
+/** An int counting its validations, which may run on any thread */
+class CountedParameter : public IntParameter {
+public:
+	CountedParameter(char shortOption, const char *longOption, const char* description)
+		: IntParameter(shortOption, longOption, description) {}
+
+	static std::atomic<int> validations;
+protected:
+	virtual int validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected) {
+		validations++;
+		return IntParameter::validate(s);
+	}
+};
+
+std::atomic<int> CountedParameter::validations(0);
+
+/** Expensive parameters, validated on threads threads */
+static void addExpensive(OptionsParser& optp, unsigned threads, int& mirrored) {
+	ParameterSet& ps = optp.getParameters();
+	ps.add<IntParameter>('i', "int", "").setExpensive();
+	ps.add<DoubleParameter>('d', "double", "").setExpensive();
+	ps.add<StringParameter>('s', "string", "").setExpensive();
+	ps.add<SwitchParameter>('v', "verbose", "");
+
+	RegisteredParameter<IntParameter>& m = ps.add<RegisteredParameter<IntParameter> >('m', "mirrored", "");
+	m.setExpensive();
+	m.bind(&mirrored);
+
+	optp.setValidationThreads(threads);
+}
+
+static void deferredValidation() {
+	const std::initializer_list<const char*> lines[] = {
+		{ "-i", "12", "--double=2.5", "-sx", "-m7", "file" },
+		{ "--int=x", "-d", "2.5", "--mirrored=8", "-v" },
+		{ "-i1", "--int=2", "-m", "nine", "--double=y", "-s", "" },
+		{ "-vi", "3", "--mirrored=4", "--", "-m5" },
+		{ "-d1", "--int=x", "-v", "-s", "y", "--mirrored=8", "file" },
+		{ "-s", "z", "-mx", "-i4", "--unknown", "-d2" },
+		{ "-m3", "-dq", "-v", "-s", "", "-m4" },
+	};
+
+	for(size_t line = 0; line < sizeof(lines) / sizeof(lines[0]); line++) {
+		/* Collecting every error */
+		int serialMirror = 1, deferredMirror = 1;
+		OptionsParser serial("check"), deferred("check");
+		addExpensive(serial, 0, serialMirror);
+		addExpensive(deferred, 4, deferredMirror);
+
+		ParseErrors serialErrors, deferredErrors;
+		CHECK(parse(serial, lines[line], serialErrors) == parse(deferred, lines[line], deferredErrors));
+		CHECK(outcome(serialErrors) == outcome(deferredErrors));
+		CHECK(outcome(serial) == outcome(deferred));
+		CHECK(serialMirror == deferredMirror);
+		CHECK(serial.getFiles() == deferred.getFiles());
+
+		/* The errors found after the scan are merged into a list that fills up */
+		ParseErrors serialFirst(2), deferredFirst(2);
+		serial.reset();
+		deferred.reset();
+		parse(serial, lines[line], serialFirst);
+		parse(deferred, lines[line], deferredFirst);
+		CHECK(outcome(serialFirst) == outcome(deferredFirst));
+
+		/* Throwing the first one, and stopping there */
+		string serialWhat, deferredWhat;
+		serialMirror = deferredMirror = 1;
+		serial.reset();
+		deferred.reset();
+		try { parse(serial, lines[line]); } catch(runtime_error& e) { serialWhat = e.what(); }
+		try { parse(deferred, lines[line]); } catch(runtime_error& e) { deferredWhat = e.what(); }
+		CHECK(serialWhat == deferredWhat);
+		CHECK(outcome(serial) == outcome(deferred));
+		CHECK(serialMirror == deferredMirror);
+		CHECK(serial.getFiles() == deferred.getFiles());
+	}
+
+	/* A rejected argument neither sets the parameter nor counts as given */
+	for(unsigned threads = 0; threads <= 4; threads += 4) {
+		int mirrored = 1;
+		OptionsParser optp("check");
+		addExpensive(optp, threads, mirrored);
+		ParameterSet& ps = optp.getParameters();
+
+		ParseErrors errors;
+		CHECK(!parse(optp, { "--int=x", "-my" }, errors));
+		CHECK(errors.size() == 2);
+		CHECK(!ps['i'].isSet() && !optp.wasGiven(ps['i']));
+		CHECK(!optp.wasGiven(ps['m']));
+		CHECK(mirrored == 1);
+
+		/* The mirrored variable follows a value validated after the scan */
+		optp.reset();
+		CHECK(parse(optp, { "--mirrored=6" }, errors));
+		CHECK(mirrored == 6);
+	}
+
+	/* Stopping at a failed argument takes the arguments before it again, but
+	 * doesn't validate them again */
+	OptionsParser optp("check");
+	ParameterSet& ps = optp.getParameters();
+	ps.add<CountedParameter>('a', "a", "").setExpensive();
+	ps.add<CountedParameter>('b', "b", "").setExpensive();
+	ps.add<CountedParameter>('c', "c", "").setExpensive();
+	ps.add<SwitchParameter>('v', "verbose", "");
+	optp.setValidationThreads(4);
+
+	string what;
+	CountedParameter::validations = 0;
+	try { parse(optp, { "-a1", "-b", "x", "-v", "-c3" }); } catch(runtime_error& e) { what = e.what(); }
+	CHECK(what == "Expected int");
+	CHECK(CountedParameter::validations == 4);
+	CHECK(ps['a'].get<int>() == 1 && optp.wasGiven(ps['a']));
+	CHECK(!optp.wasGiven(ps['b']) && !optp.wasGiven(ps['c']) && !ps['v'].isSet());
+}
+
+/*
+ *
+ * Exporting the configuration
+ *
+ */
+
+static void addExported(OptionsParser& optp, bool defaults) {
+	ParameterSet& ps = optp.getParameters();
+	ps.add<SwitchParameter>('v', "verbose", "");
+	ps.add<StringParameter>('s', "string", "");
+	StringParameter& name = ps.add<StringParameter>(0, "name", "");
+	IntParameter& number = ps.add<IntParameter>('i', "int", "");
+	ps.add<IntParameter>('j', "jobs", "");
+	if(defaults) {
+		name.setDefault("x\"y\n");
+		number.setDefault(3);
+	}
+}
+
+/** Read back a string of the binary export */
+static bool readRecord(const string& data, size_t& at, string& s) {
+	uint32_t length;
+	if(at + sizeof(length) > data.size()) return false;
+	memcpy(&length, &data[at], sizeof(length));
+	at += sizeof(length);
+	if(length == 0xffffffff) {
+		s = "null";
+		return true;
+	}
+	if(at + length > data.size()) return false;
+	s.assign(data, at, length);
+	at += length;
+	return true;
+}
+
+static void exportedConfig() {
+	OptionsParser optp("check");
+	addExported(optp, true);
+	parse(optp, { "-v", "--jobs=5", "a" });
+
+	char buffer[1024];
+	BufferSink json(buffer, sizeof(buffer));
+	optp.getParameters().exportConfig(json);
+	CHECK(string(buffer, json.length()) == "["
+		"{\"name\":\"verbose\",\"short\":\"v\",\"type\":\"switch\",\"value\":null,\"source\":\"command-line\",\"set\":true},"
+		"{\"name\":\"string\",\"short\":\"s\",\"type\":\"string\",\"value\":\"\",\"source\":\"default\",\"set\":true},"
+		"{\"name\":\"name\",\"short\":null,\"type\":\"string\",\"value\":\"x\\\"y\\n\",\"source\":\"preset\",\"set\":true},"
+		"{\"name\":\"int\",\"short\":\"i\",\"type\":\"int\",\"value\":\"3\",\"source\":\"preset\",\"set\":true},"
+		"{\"name\":\"jobs\",\"short\":\"j\",\"type\":\"int\",\"value\":\"5\",\"source\":\"command-line\",\"set\":true}]");
+
+	/* The binary form holds the same fields */
+	string binary;
+	CallbackSink collect([](const char* data, size_t length, void* out) {
+		static_cast<string*>(out)->append(data, length);
+	}, &binary);
+	optp.getParameters().exportConfig(collect, ParameterSet::EXPORT_BINARY);
+
+	uint32_t count = 0;
+	CHECK(binary.compare(0, 4, "GOX1") == 0 && binary.size() >= 8);
+	memcpy(&count, &binary[4], sizeof(count));
+	CHECK(count == 5);
+
+	string fields;
+	size_t at = 8;
+	for(uint32_t i = 0; i < count && at + 3 <= binary.size(); i++) {
+		static const char* const sources[] = { "default", "preset", "command-line" };
+		int source = binary[at];
+		bool set = binary[at + 1];
+		char shortOption = binary[at + 2];
+		at += 3;
+
+		string type, name, value;
+		CHECK(source >= 0 && source <= 2);
+		CHECK(readRecord(binary, at, type) && readRecord(binary, at, name) && readRecord(binary, at, value));
+		fields += name + " " + (shortOption ? string(1, shortOption) : "-") + " " + type + " " + value +
+				" " + sources[source % 3] + (set ? " set\n" : "\n");
+	}
+	CHECK(at == binary.size());
+	CHECK(fields ==
+		"verbose v switch null command-line set\n"
+		"string s string  default set\n"
+		"name - string x\"y\n preset set\n"
+		"int i int 3 preset set\n"
+		"jobs j int 5 command-line set\n");
+
+	/* Only real defaults are passed on, and parse back to the same values */
+	ArgvBuilder args;
+	args.add("check").addParameters(optp, true).addFiles(optp.getFiles());
+	vector<string> built(args.argv() + 1, args.argv() + args.argc());
+	CHECK(built == vector<string>({ "--verbose", "--name=x\"y\n", "--int=3", "--jobs=5", "a" }));
+
+	OptionsParser other("check");
+	addExported(other, false);
+	other.parse(args.argc(), (const char**) args.argv());
+
+	BufferSink otherJson(buffer, sizeof(buffer));
+	other.getParameters().exportConfig(otherJson);
+	string expected = "[{\"name\":\"verbose\",\"short\":\"v\",\"type\":\"switch\",\"value\":null,\"source\":\"command-line\",\"set\":true},"
+		"{\"name\":\"string\",\"short\":\"s\",\"type\":\"string\",\"value\":\"\",\"source\":\"default\",\"set\":true},"
+		"{\"name\":\"name\",\"short\":null,\"type\":\"string\",\"value\":\"x\\\"y\\n\",\"source\":\"command-line\",\"set\":true},"
+		"{\"name\":\"int\",\"short\":\"i\",\"type\":\"int\",\"value\":\"3\",\"source\":\"command-line\",\"set\":true},"
+		"{\"name\":\"jobs\",\"short\":\"j\",\"type\":\"int\",\"value\":\"5\",\"source\":\"command-line\",\"set\":true}]";
+	CHECK(string(buffer, otherJson.length()) == expected);
+	CHECK(other.getFiles() == optp.getFiles());
+}
+
+/*
+ *
+ * Snapshots
+ *
+ */
+
+static void snapshotRestore() {
+	OptionsParser source("check"), target("check");
+	OptionsParser* parsers[] = { &source, &target };
+	for(int i = 0; i < 2; i++) {
+		ParameterSet& ps = parsers[i]->getParameters();
+		ps.add<StringParameter>('s', "string", "");
+		ps.add<IntParameter>('i', "int", "");
+	}
+
+	parse(source, { "-sfrom", "-i", "1234567", "a" });
+	string saved;
+	source.snapshot(saved);
+
+	parse(target, { "-sto", "b" });
+	target.restore(saved.data(), saved.size());
+	CHECK(target.getParameters()['s'].get<string>() == "from");
+	CHECK(target.getParameters()['i'].get<int>() == 1234567);
+	CHECK(target.getFiles() == vector<string>(1, "a"));
+
+	/* Shorten the int's record by a byte, which keeps the snapshot's own
+	 * framing intact: the string before it must not be restored either */
+	const int value = 1234567;
+	string record(4, '\0');
+	record[0] = sizeof(int);
+	record.append((const char*) &value, sizeof(value));
+
+	size_t at = saved.find(record);
+	CHECK(at != string::npos);
+	if(at == string::npos) return;
+	saved[at]--;
+
+	parse(target, { "-sto", "b" });
+	bool thrown = false;
+	try {
+		target.restore(saved.data(), saved.size());
+	} catch(OptionsParser::InvalidSnapshot& e) {
+		thrown = true;
+	}
+	CHECK(thrown);
+	CHECK(target.getParameters()['s'].get<string>() == "to");
+	CHECK(!target.getParameters()['i'].isSet());
+	CHECK(target.getFiles() == vector<string>(1, "b"));
+}
+
+/*
+ *
+ * Live options
+ *
+ */
+
+static void liveReload(LiveOptions& live, int number) {
+	string argument = "--number=" + std::to_string(number);
+	const char* argv[] = { "check", argument.c_str() };
+	live.reload(2, argv);
+}
+
+static void liveReaders() {
+	OptionsParser optp("check");
+	IntParameter& number = optp.getParameters().add<IntParameter>('n', "number", "");
+	parse(optp, { "--number=0" });
+	LiveOptions live(optp);
+
+	/* A snapshot entered before a reload survives the reclaim after it */
+	{
+		LiveOptions::Reader reader(live);
+		const OptionsSnapshot* entered = reader.enter();
+		liveReload(live, 1);
+		live.reclaim();
+		CHECK(entered->generation() == 0 && entered->get<int>(number) == 0);
+		reader.leave();
+		live.reclaim();
+		CHECK(live.current()->get<int>(number) == 1);
+	}
+
+	/* Readers on other threads, while reloads are reclaimed right away */
+	std::atomic<bool> done(false);
+	std::atomic<int> wrong(0);
+	vector<std::thread> readers;
+	for(int t = 0; t < 4; t++) {
+		readers.push_back(std::thread([&live, &number, &done, &wrong]() {
+			LiveOptions::Reader reader(live);
+			uint64_t last = 0;
+			while(!done) {
+				const OptionsSnapshot* options = reader.enter();
+				if(options->generation() < last || options->get<int>(number) != (int) options->generation()) wrong++;
+				last = options->generation();
+				reader.leave();
+			}
+		}));
+	}
+	for(int i = 2; i < 500; i++) {
+		liveReload(live, i);
+		live.reclaim();
+	}
+	done = true;
+	for(size_t t = 0; t < readers.size(); t++) readers[t].join();
+	CHECK(wrong == 0);
+}
+
+/*
+ *
+ * Units
+ *
+ */
+
+/** An argument parsed and formatted back, or why it was rejected. What is
+ * formatted must parse to the same value, and format the same again. */
+template<typename P>
+static string formatted(const string& argument, typename P::value_type* parsed = NULL) {
+	OptionsParser optp("check"), again("check");
+	P& p = optp.getParameters().add<P>('p', "param", "");
+	P& q = again.getParameters().add<P>('p', "param", "");
+
+	ParseErrors errors;
+	if(!parse(optp, { ("--param=" + argument).c_str() }, errors)) return errors[0].message;
+
+	string out, out2;
+	CHECK(p.formatArgument(out));
+	CHECK(parse(again, { ("--param=" + out).c_str() }, errors));
+	CHECK(q.formatArgument(out2) && out2 == out);
+	CHECK(p.getValue() == q.getValue());
+
+	if(parsed) *parsed = p.getValue();
+	return out;
+}
+
+static void sizes() {
+	ByteSize size;
+	CHECK(formatted<SizeParameter>("4G", &size) == "4G" && size.bytes() == 4ULL << 30);
+	CHECK(formatted<SizeParameter>("1.5m", &size) == "1536K" && size.bytes() == 1572864);
+	CHECK(formatted<SizeParameter>("0.5KiB") == "512");
+	CHECK(formatted<SizeParameter>("15E") == "15E");
+	CHECK(formatted<SizeParameter>("18446744073709551615") == "18446744073709551615");
+
+	CHECK(formatted<SizeParameter>("16E") == "--param: Expected a size (e.g. 4G): value is too large");
+	CHECK(formatted<SizeParameter>("18446744073709551616") == "--param: Expected a size (e.g. 4G): value is too large");
+	CHECK(formatted<SizeParameter>("1.5b") == "--param: Expected a size (e.g. 4G): fraction is too small");
+	CHECK(formatted<SizeParameter>("4Q") == "--param: Expected a size (e.g. 4G): unknown unit");
+}
+
+static void durations() {
+	std::chrono::nanoseconds duration;
+	CHECK(formatted<DurationParameter>("1h30m", &duration) == "90m" && duration == std::chrono::minutes(90));
+	CHECK(formatted<DurationParameter>("1.5m", &duration) == "90s" && duration == std::chrono::seconds(90));
+	CHECK(formatted<DurationParameter>("0") == "0");
+	CHECK(formatted<DurationParameter>("250ms") == "250ms");
+
+	/* The largest duration, in one part and in several */
+	CHECK(formatted<DurationParameter>("9223372036854775807ns") == "9223372036854775807ns");
+	CHECK(formatted<DurationParameter>("106751d23h47m16s854775807ns") == "9223372036854775807ns");
+	CHECK(formatted<DurationParameter>("9223372036854775808ns") ==
+		"--param: Expected a duration (e.g. 250ms or 1h30m): value is too large");
+	CHECK(formatted<DurationParameter>("106751d23h47m16s854775808ns") ==
+		"--param: Expected a duration (e.g. 250ms or 1h30m): value is too large");
+	CHECK(formatted<DurationParameter>("5") == "--param: Expected a duration (e.g. 250ms or 1h30m): expected a unit");
+}
+
+static void rangeSets() {
+	RangeSet set;
+	CHECK(formatted<RangeSetParameter>("0-31,64-95", &set) == "0-31,64-95");
+	CHECK(set.contains(0) && set.contains(31) && !set.contains(32) && set.contains(64) && !set.contains(96));
+	CHECK(set.count() == 64);
+
+	CHECK(formatted<RangeSetParameter>("5,3,1-2,70000-70001,4294967295") == "1-3,5,70000-70001,4294967295");
+	CHECK(formatted<RangeSetParameter>("4294967296") ==
+		"--param: Expected a list of ranges (e.g. 0-31,64-95): value is too large");
+	CHECK(formatted<RangeSetParameter>("1.5") ==
+		"--param: Expected a list of ranges (e.g. 0-31,64-95): ranges take integers");
+	CHECK(formatted<RangeSetParameter>("2.0") ==
+		"--param: Expected a list of ranges (e.g. 0-31,64-95): ranges take integers");
+	CHECK(formatted<RangeSetParameter>("3-1") ==
+		"--param: Expected a list of ranges (e.g. 0-31,64-95): range ends before it starts");
+}
+
+static void rangeSetAdd() {
+	/* Adding intervals one at a time gives the set built from all of them at once */
+	for(uint32_t spread = 1000; spread <= 1000000; spread *= 1000) {
+		srand(spread);
+		vector<RangeSet::Interval> intervals;
+		RangeSet added;
+
+		for(int i = 0; i < 300; i++) {
+			uint32_t first = rand() % spread, last = first + rand() % 20;
+			intervals.push_back(make_pair(first, last));
+			added.add(last, first);
+
+			RangeSet built(intervals);
+			CHECK(added == built);
+		}
+
+		RangeSet built(intervals);
+		size_t differ = 0;
+		for(uint32_t n = 0; n < spread + 100; n += (spread / 1000)) {
+			if(added.contains(n) != built.contains(n)) differ++;
+		}
+		CHECK(differ == 0);
+	}
+
+	/* Intervals touching at either end, or spanning several */
+	RangeSet set;
+	set.add(10, 19);
+	set.add(30, 39);
+	set.add(20, 29);
+	set.add(0, 9);
+	set.add(50, 60);
+	set.add(45, 70);
+	CHECK(set.intervals() == vector<RangeSet::Interval>({ make_pair(0U, 39U), make_pair(45U, 70U) }));
+	set.add(UINT32_MAX, 40);
+	CHECK(set.intervals() == vector<RangeSet::Interval>({ make_pair(0U, UINT32_MAX) }));
+	CHECK(set.contains(UINT32_MAX) && set.contains(100000));
+}
+
+static void unitSnapshot() {
+	OptionsParser source("check"), target("check");
+	OptionsParser* parsers[] = { &source, &target };
+	for(int i = 0; i < 2; i++) {
+		ParameterSet& ps = parsers[i]->getParameters();
+		ps.add<SizeParameter>('s', "size", "");
+		ps.add<DurationParameter>('d', "duration", "");
+		ps.add<RangeSetParameter>('r', "ranges", "");
+	}
+
+	parse(source, { "-s", "4G", "-d", "1h30m", "-r", "0-3,8" });
+	string saved;
+	source.snapshot(saved);
+	target.restore(saved.data(), saved.size());
+	CHECK(target.getParameters()['s'].get<ByteSize>().bytes() == (4ULL << 30));
+	CHECK(target.getParameters()['d'].get<std::chrono::nanoseconds>() == std::chrono::minutes(90));
+	CHECK(target.getParameters()['r'].get<RangeSet>().count() == 5);
+
+	/* Only types with a meaning outside the process are saved as bytes */
+	struct Pair { int a; char* b; };
+	CHECK(ValueCodec<long>::supported && ValueCodec<Colour>::supported);
+	CHECK(!ValueCodec<Pair>::supported);
+}
+
+/*
+ *
+ * Validators
+ *
+ */
+
+static void characterSpans() {
+	const CharClass classes[] = { CharClass::hex(), CharClass::identifier(), CharClass::any(), CharClass("-a-c"),
+		CharClass("acegikmoqsuwy") };
+
+	/* Every offset of the first stray character, on either side of the vector widths */
+	string s(100, 'a');
+	for(size_t c = 0; c < sizeof(classes) / sizeof(classes[0]); c++) {
+		for(size_t stray = 0; stray <= s.length(); stray++) {
+			for(int value = 0; value < 256; value += 37) {
+				string t = s;
+				if(stray < t.length()) t[stray] = value;
+
+				size_t expected = 0;
+				while(expected < t.length() && classes[c].contains(t[expected])) expected++;
+				CHECK(classes[c].span(t.data(), t.length()) == expected);
+			}
+		}
+	}
+}
+
+static void validatedStrings() {
+	for(unsigned threads = 0; threads <= 2; threads += 2) {
+		OptionsParser optp("check");
+		ValidatedStringParameter& key = optp.getParameters().add<ValidatedStringParameter>('k', "key", "");
+		key.setExpensive();
+		key.validator().pattern("[0-9a-f]{4}");
+		optp.setValidationThreads(threads);
+
+		/* The offset survives the message being prefixed with the option */
+		const char* arguments[] = { "--key=12x4", "-k12x4" };
+		for(int i = 0; i < 2; i++) {
+			size_t offset = 0;
+			string what;
+			try {
+				parse(optp, { arguments[i] });
+			} catch(StringValidator::InvalidString& e) {
+				offset = e.offset();
+				what = e.what();
+			}
+			CHECK(offset == 2);
+			CHECK(what.find("offset 2") != string::npos);
+			CHECK((what.compare(0, 6, "--key:") == 0) == (i == 0));
+		}
+
+		ParseErrors errors;
+		CHECK(!parse(optp, { "--key=12x4" }, errors));
+		CHECK(errors.size() == 1 && errors[0].kind == ParseError::BAD_VALUE);
+		CHECK(errors.size() == 1 && errors[0].message.find("--key: invalid character 'x' at offset 2") == 0);
+	}
+}
+
+/*
+ *
+ * Output sinks
+ *
+ */
+
+static void addDescribed(OptionsParser& optp) {
+	ParameterSet& ps = optp.getParameters();
+	ps.add<SwitchParameter>('v', "verbose", "Say more");
+	ps.add<IntParameter>('n', "number", "How many");
+	ps.add<StringParameter>('o', "a-rather-long-option", "Where to");
+}
+
+static void appendText(const char* data, size_t length, void* context) {
+	static_cast<string*>(context)->append(data, length);
+}
+
+static void usageText() {
+	OptionsParser optp("Checks the usage text");
+	addDescribed(optp);
+	parse(optp, {});
+
+	string text;
+	CallbackSink collect(appendText, &text);
+	optp.usage(collect);
+
+	/* The parameters come in no particular order, each padded to its columns */
+	const char* header = "Usage: check arguments\nChecks the usage text\n\nParameters: \n";
+	const char* lines[] = {
+		"    -v        --verbose           Say more                                \n",
+		"    -narg     --number=arg        How many                                \n",
+		"    -oarg     --a-rather-long-option=argWhere to                                \n",
+	};
+	CHECK(text.compare(0, strlen(header), header) == 0);
+	size_t length = strlen(header);
+	for(size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+		CHECK(text.find(lines[i]) != string::npos);
+		length += strlen(lines[i]);
+	}
+	CHECK(text.length() == length);
+
+	/* A buffer keeps what fits, nul terminated */
+	char buffer[1024];
+	BufferSink whole(buffer, sizeof(buffer));
+	optp.usage(whole);
+	CHECK(!whole.truncated() && whole.length() == text.length() && buffer == text);
+
+	BufferSink part(buffer, 20);
+	optp.usage(part);
+	CHECK(part.truncated() && part.length() == 19 && buffer == text.substr(0, 19));
+
+	/* Files, descriptors and streams get the same text */
+	FILE* file = tmpfile();
+	CHECK(file != NULL);
+	if(file) {
+		FileSink out(file);
+		optp.usage(out);
+		rewind(file);
+		size_t read = fread(buffer, 1, sizeof(buffer), file);
+		CHECK(string(buffer, read) == text);
+		fclose(file);
+	}
+
+	int fds[2];
+	CHECK(pipe(fds) == 0);
+	FdSink pipeSink(fds[1]);
+	optp.usage(pipeSink);
+	close(fds[1]);
+	string piped;
+	for(ssize_t n; (n = read(fds[0], buffer, sizeof(buffer))) > 0; ) piped.append(buffer, n);
+	close(fds[0]);
+	CHECK(piped == text);
+
+	std::ostringstream stream;
+	OStreamSink streamSink(stream);
+	optp.usage(streamSink);
+	CHECK(stream.str() == text);
+}
+
+/*
+ *
+ * Building command lines
+ *
+ */
+
+static void argvRoundTrip() {
+	OptionsParser optp("check");
+	ParameterSet& ps = optp.getParameters();
+	StringParameter& output = ps.add<StringParameter>('o', "", "");
+	SwitchParameter& verbose = ps.add<SwitchParameter>('v', "", "");
+	StringParameter& name = ps.add<StringParameter>('n', "name", "");
+
+	parse(optp, { "-o", "", "-v", "--name=", "file" });
+	CHECK(output.isSet() && output.get<string>() == "");
+	CHECK(verbose.isSet());
+	CHECK(name.isSet() && name.get<string>() == "");
+
+	/* Parsing the built command line again must give the same values */
+	ArgvBuilder args;
+	args.add("check").addParameters(optp).addFiles(optp.getFiles());
+	optp.parse(args.argc(), (const char**) args.argv());
+	CHECK(output.isSet() && output.get<string>() == "");
+	CHECK(verbose.isSet());
+	CHECK(name.isSet() && name.get<string>() == "");
+	CHECK(optp.getFiles() == vector<string>(1, "file"));
+
+	args.clear();
+	args.override(output, "");
+	args.add("check").addParameter(output).add("file");
+	CHECK(args.argc() == 4);
+	optp.parse(args.argc(), (const char**) args.argv());
+	CHECK(output.get<string>() == "");
+	CHECK(optp.getFiles() == vector<string>(1, "file"));
+}
+
+/*
+ *
+ * Glob expansion
+ *
+ */
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+	return remove(path);
+}
+
+static void globExpansion() {
+	char root[] = "/tmp/getoptpp-check-XXXXXX";
+	CHECK(mkdtemp(root) != NULL);
+	string base = string(root) + "/";
+
+	const char* directories[] = { "sub", "sub/deep", ".hidden", "empty" };
+	for(size_t i = 0; i < sizeof(directories) / sizeof(directories[0]); i++) {
+		CHECK(mkdir((base + directories[i]).c_str(), 0700) == 0);
+	}
+	const char* names[] = { "b.txt", "a.txt", "x.log", "sub/c.txt", "sub/deep/d.txt", ".hidden/e.txt", ".f.txt" };
+	for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		FILE* f = fopen((base + names[i]).c_str(), "w");
+		CHECK(f != NULL);
+		if(f) fclose(f);
+	}
+
+	vector<string> matches;
+	CHECK(GlobExpander(3).expand(base + "**/*.txt", matches));
+	const char* expected[] = { "a.txt", "b.txt", "sub/c.txt", "sub/deep/d.txt" };
+	CHECK(matches.size() == 4);
+	for(size_t i = 0; i < matches.size() && i < 4; i++) CHECK(matches[i] == base + expected[i]);
+
+	matches.clear();
+	CHECK(!GlobExpander(3).expand(base + "empty/*", matches));
+	CHECK(matches.empty());
+
+	/* One thread and several, with and without a memory resource, give the
+	 * same files: sorted per pattern, each once, unmatched patterns as given */
+	for(unsigned threads = 1; threads <= 4; threads += 3) {
+		for(int arena = 0; arena < 2; arena++) {
+			MonotonicResource resource;
+			OptionsParser optp("check");
+			if(arena) optp.setMemoryResource(&resource);
+			optp.setGlobExpansion(true, threads);
+
+			string patterns[] = { base + "*.txt", base + "**/*.txt", base + "*.csv", base + "x.log" };
+			parse(optp, { patterns[0].c_str(), patterns[1].c_str(), patterns[2].c_str(), patterns[3].c_str() });
+
+			vector<string> files;
+			files.push_back(base + "a.txt");
+			files.push_back(base + "b.txt");
+			files.push_back(base + "sub/c.txt");
+			files.push_back(base + "sub/deep/d.txt");
+			files.push_back(patterns[2]);
+			files.push_back(patterns[3]);
+			CHECK(optp.getFiles() == files);
+			optp.reset();
+		}
+	}
+
+	nftw(root, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+#if __cplusplus >= 201703L
+#include "pmr.h"
+
+static void pmrResource() {
+	/* The files of a parse go to the std::pmr resource */
+	char arena[4096];
+	std::pmr::monotonic_buffer_resource buffer(arena, sizeof(arena), std::pmr::null_memory_resource());
+	PmrResource resource(&buffer);
+
+	OptionsParser optp("check");
+	optp.setMemoryResource(&resource);
+	parse(optp, { "first", "second" });
+
+	size_t length;
+	const char* name = optp.file(1, length);
+	CHECK(string(name, length) == "second");
+	CHECK(name >= arena && name < arena + sizeof(arena));
+	CHECK(optp.getFiles() == vector<string>({ "first", "second" }));
+	optp.reset();
+}
+#endif
+
+/*
+ *
+ * Interned strings
+ *
+ */
+
+static void interning() {
+	InternTable table;
+	InternedString a = table.intern("queue"), b = table.intern(string("queue"));
+	CHECK(a == b && a.entry() == b.entry());
+	CHECK(a != table.intern("queues"));
+	CHECK(table.find(a.id()) == a);
+	CHECK(a.str() == "queue");
+
+	CHECK(table.intern("") == InternedString());
+	CHECK(table.intern("", 0).id() == InternTable::NO_ID);
+	CHECK(table.size() == 2);
+
+	/* Threads interning the same strings all get the same entries */
+	const int THREADS = 8, STRINGS = 200;
+	vector<vector<InternedString> > found(THREADS, vector<InternedString>(STRINGS));
+	vector<std::thread> threads;
+	for(int t = 0; t < THREADS; t++) {
+		threads.push_back(std::thread([&table, &found, t]() {
+			for(int i = 0; i < STRINGS; i++) {
+				int n = (i * 7 + t * 13) % STRINGS;
+				found[t][n] = table.intern("value" + std::to_string(n));
+			}
+		}));
+	}
+	for(int t = 0; t < THREADS; t++) threads[t].join();
+
+	CHECK(table.size() == 2 + STRINGS);
+	for(int i = 0; i < STRINGS; i++) {
+		for(int t = 1; t < THREADS; t++) CHECK(found[t][i] == found[0][i]);
+		CHECK(found[0][i].str() == "value" + std::to_string(i));
+		CHECK(table.find(found[0][i].id()) == found[0][i]);
+	}
+}
+
+static void internedSnapshot() {
+	InternTable sourceTable, targetTable;
+	OptionsParser source("check"), target("check");
+	InternedStringParameter& from = source.getParameters().add<InternedStringParameter>('q', "queue", "");
+	InternedStringParameter& to = target.getParameters().add<InternedStringParameter>('q', "queue", "");
+	from.setTable(sourceTable).setDefault(sourceTable.intern("low"));
+	to.setTable(targetTable).setDefault(targetTable.intern("none"));
+
+	parse(source, { "--queue=urgent" });
+	string saved;
+	source.snapshot(saved);
+
+	size_t shared = InternTable::shared().size();
+	target.restore(saved.data(), saved.size());
+	CHECK(to.get<InternedString>() == targetTable.intern("urgent"));
+	CHECK(InternTable::shared().size() == shared);
+	CHECK(targetTable.size() == 3);
+
+	/* The default came along, interned into the target's table too */
+	target.reset();
+	CHECK(to.get<InternedString>() == targetTable.intern("low"));
+	CHECK(targetTable.size() == 3);
+}
+
+static const struct {
+	const char* name;
+	void (*run)();
+} checks[] = {
+	{ "registry", registry },
+	{ "name pool", namePool },
+	{ "enum matching", enumMatching },
+	{ "enum duplicates", enumDuplicates },
+	{ "enum perfect hash", enumPerfectHash },
+	{ "reparse", reparse },
+	{ "collected errors", collectedErrors },
+	{ "short clusters", shortClusters },
+	{ "overridden validation", overriddenValidation },
+	{ "incremental parsing", incrementalParsing },
+#ifdef GETOPTPP_HAVE_GENERATOR
+	{ "event generator", eventGenerator },
+#endif
+	{ "constraints", constraints },
+	{ "deferred validation", deferredValidation },
+	{ "exported config", exportedConfig },
+	{ "snapshot restore", snapshotRestore },
+	{ "live readers", liveReaders },
+	{ "character spans", characterSpans },
+	{ "validated strings", validatedStrings },
+	{ "sizes", sizes },
+	{ "durations", durations },
+	{ "range sets", rangeSets },
+	{ "range set add", rangeSetAdd },
+	{ "unit snapshot", unitSnapshot },
+	{ "usage text", usageText },
+	{ "argv round trip", argvRoundTrip },
+	{ "glob expansion", globExpansion },
+#if __cplusplus >= 201703L
+	{ "pmr resource", pmrResource },
+#endif
+	{ "interning", interning },
+	{ "interned snapshot", internedSnapshot },
+};
+
+int main(int argc, const char* argv[]) {
+	const char* only = argc > 1 ? argv[1] : "";
+
+	int run = 0;
+	for(size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+		if(strncmp(checks[i].name, only, strlen(only)) != 0) continue;
+
+		current = checks[i].name;
+		int before = failures;
+		checks[i].run();
+		printf("%-24s %s\n", current, failures == before ? "ok" : "FAILED");
+		run++;
+	}
+
+	if(!run) printf("no check named %s\n", only);
+	return failures || !run ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif
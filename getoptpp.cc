@@ -17,88 +17,1166 @@
 
 
 #include "getoptpp.h"
+#include "glob.h"
+#include "intern.h"
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <system_error>
+#include <new>
+#include <unordered_set>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
 
 namespace vlofgren {
 
+/* What a rejected argument becomes, as receiveShort() or receiveLong() word it */
+static string rejectedMessage(const Parameter& p, bool longForm, const string& what) {
+	if(!longForm) return what;
+	return what.length() ? "--" + p.longOption() + ": " + what : "--" + p.longOption() + " (unspecified error)";
+}
+
+/*
+ *
+ * Class OptionsParser
+ *
+ *
+ */
+
+struct OptionsParser::GlobSeen : public unordered_set<string> {};
+
+OptionsParser::OptionsParser(const char* programDesc) : fprogramDesc(programDesc), flongIndexed(0), fcurrent(NULL), fregistered(false), fvalidationThreads(0), fmatched(NULL), fresource(NULL), ffilesStale(false), fglob(false), fglobThreads(0), fglobSeen(NULL) {}
+OptionsParser::~OptionsParser() {
+	releaseRegisteredOptions();
+	clearFiles();
+	delete fglobSeen;
+}
+
+ParameterSet& OptionsParser::getParameters() {
+	return parameters;
+}
+
+const ParameterSet& OptionsParser::getParameters() const {
+	return parameters;
+}
+
+void OptionsParser::parse(int argc, const char* argv[]) GETOPTPP_THROW(runtime_error)
+{
+	parseArguments(argc, argv, NULL);
+}
+
+bool OptionsParser::parse(int argc, const char* argv[], ParseErrors& errors)
+{
+	errors.clear();
+	parseArguments(argc, argv, &errors);
+	return errors.empty();
+}
+
+void OptionsParser::parseArguments(int argc, const char* argv[], ParseErrors* errors)
+{
+	beginArguments(argv[0]);
+
+	/* Assigning over the last parse's strings reuses their buffers */
+	if(argc > 1) ftokens.assign(&argv[1], &argv[argc]);
+	else ftokens.clear();
+
+	DeferredValidation deferred(fvalidationThreads);
+
+	/* Take the options, up to the files; true if the errors filled up first */
+	auto scan = [&](ParserState& state) {
+		for(; !state.end(); state.advance()) {
+			deferred.at(state.position(), state.get());
+			if(!dispatchArgument(state, errors)) return false;
+			if(errors && errors->full()) return true;
+		}
+		return false;
+	};
+
+	ParserState first(*this, ftokens), again(*this, ftokens);
+	ParserState* state = &first;
+	bool full;
+
+	try {
+		try {
+			full = scan(first);
+		} catch(...) {
+			/* An expensive parameter earlier in argv may have failed as well, and
+			 * would have been thrown first by a serial parse. */
+			deferred.finish(NULL);
+			throw;
+		}
+
+		vector<const Parameter*> rejected;
+		deferred.finish(errors, &rejected);
+		for(size_t i = 0; i < rejected.size(); i++) unmarkGiven(*rejected[i]);
+	} catch(...) {
+		if(!deferred.replay()) throw;
+
+		/* An expensive parameter failed, but the scan took the arguments after
+		 * it: scan again up to where a serial parse stops, without validating
+		 * the expensive arguments before it again */
+		beginArguments(argv[0]);
+		if(errors) errors->clear();
+		state = &again;
+		full = scan(again);
+	}
+	if(full) return;
+
+	for(; !state->end(); state->advance()) {
+		receiveFile(state->get().data(), state->get().size());
+	}
+
+	parameters.checkConstraints(fgiven, frequired, errors);
+}
+
+void OptionsParser::setValidationThreads(unsigned threads) {
+	fvalidationThreads = threads;
+}
+
+void OptionsParser::setMemoryResource(MemoryResource* resource) {
+	clearFiles();
+	files.clear();
+	fresource = resource;
+	vector<FileEntry, ResourceAllocator<FileEntry> >(
+			ResourceAllocator<FileEntry>(resource ? resource : MemoryResource::newDelete())).swap(ffileEntries);
+}
+
+MemoryResource* OptionsParser::memoryResource() const {
+	return fresource;
+}
+
+void OptionsParser::setGlobExpansion(bool expand, unsigned threads) {
+	fglob = expand;
+	fglobThreads = threads;
+}
+
+void OptionsParser::addFile(const char* name, size_t length) {
+	if(!fresource) {
+		files.push_back(string(name, length));
+		return;
+	}
+
+	FileEntry entry;
+	entry.name = static_cast<char*>(fresource->allocate(length + 1, 1));
+	entry.length = length;
+	memcpy(entry.name, name, length);
+	entry.name[length] = 0;
+	ffileEntries.push_back(entry);
+	ffilesStale = true;
+}
+
+void OptionsParser::receiveFile(const char* name, size_t length) {
+	if(!fglob || !GlobExpander::isPattern(name, length)) {
+		addFile(name, length);
+		return;
+	}
+
+	if(!fglobSeen) fglobSeen = new GlobSeen();
+
+	/* Each match becomes a file as soon as it is found */
+	struct Files : public GlobExpander::Sink {
+		OptionsParser& parser;
+		Files(OptionsParser& parser) : parser(parser) {}
+
+		virtual void match(const char* path, size_t length) {
+			if(parser.fglobSeen->insert(string(path, length)).second) parser.addFile(path, length);
+		}
+	} sink(*this);
+
+	size_t before = fresource ? ffileEntries.size() : files.size();
+	if(!GlobExpander(fglobThreads).expand(string(name, length), sink)) {
+		addFile(name, length);
+		return;
+	}
+
+	/* Then the new ones are put in order */
+	if(fresource) {
+		sort(ffileEntries.begin() + before, ffileEntries.end(), [](const FileEntry& a, const FileEntry& b) {
+			int order = memcmp(a.name, b.name, min(a.length, b.length));
+			return order ? order < 0 : a.length < b.length;
+		});
+	} else {
+		sort(files.begin() + before, files.end());
+	}
+}
+
+void OptionsParser::clearFiles() {
+	files.clear();
+	if(fglobSeen) fglobSeen->clear();
+	if(fresource) for(size_t i = 0; i < ffileEntries.size(); i++) {
+		fresource->deallocate(ffileEntries[i].name, ffileEntries[i].length + 1, 1);
+	}
+	/* Give the storage back too, since the resource may be released after this */
+	vector<FileEntry, ResourceAllocator<FileEntry> >(ffileEntries.get_allocator()).swap(ffileEntries);
+	ffilesStale = false;
+}
+
+void OptionsParser::beginArguments(const string& programName) {
+	argv0 = programName;
+	reset();
+
+	buildIndex();
+	fgiven.assign((parameters.size() + 63) / 64, 0);
+}
+
+bool OptionsParser::dispatchArgument(ParserState& state, ParseErrors* errors) GETOPTPP_THROW(runtime_error) {
+	if(!errors) return receiveArgument(state, NULL);
+
+	/* Errors are recorded against the element the option started in, which
+	 * is the option rather than the argument for -o argument.
+	 */
+	int position = state.position();
+	bool longForm = state.get().compare(0, 2, "--") == 0;
+	RejectedArgument rejection(true);
+	try {
+		bool more = receiveArgument(state, errors);
+		if(rejection.rejected()) {
+			errors->add(ParseError::BAD_VALUE, position, fcurrent, rejectedMessage(*fcurrent, longForm, rejection.what()));
+		}
+		return more;
+	} catch(Parameter::AlreadySet &e) {
+		errors->add(ParseError::DUPLICATE_OPTION, position, fcurrent, e.what());
+	} catch(Parameter::ExpectedArgument &e) {
+		errors->add(ParseError::MISSING_ARGUMENT, position, fcurrent, e.what());
+	} catch(Parameter::UnexpectedArgument &e) {
+		errors->add(ParseError::UNEXPECTED_ARGUMENT, position, fcurrent, e.what());
+	} catch(Parameter::ParameterRejected &e) {
+		errors->add(ParseError::BAD_VALUE, position, fcurrent, e.what());
+	}
+
+	return true;
+}
+
+bool OptionsParser::receiveArgument(ParserState& state, ParseErrors* errors) GETOPTPP_THROW(runtime_error) {
+	fcurrent = NULL;
+	if(receiveShortCluster(state, errors)) return true;
+	if(receiveLongOption(state)) return true;
+
+	/* Only parameters that the indexes can't decode are left to ask, which
+	 * is usually none at all, so an unknown option costs the same however
+	 * many parameters there are.
+	 */
+	for(size_t i = 0; i < fpolled.size(); i++) {
+		Parameter* p = parameters.fordered[fpolled[i]];
+		fcurrent = p;
+		if(p->receive(state)) {
+			markGiven(*p);
+			return true;
+		}
+	}
+
+	const string& file = state.get();
+	if(file == "--") {
+		state.advance();
+		return false;
+	}
+
+	fcurrent = NULL;
+	if(!file.empty() && file[0] == '-') {
+		if(!errors) throw Parameter::ParameterRejected(string("Bad parameter: ") + file);
+
+		errors->add(ParseError::UNKNOWN_OPTION, state.position(), NULL, string("Bad parameter: ") + file);
+	}
+	else receiveFile(file.data(), file.size());
+
+	return true;
+}
+
+void OptionsParser::markGiven(const Parameter& p) {
+	/* Unless it rejected its argument, and reported that rather than throwing */
+	RejectedArgument* rejection = RejectedArgument::active();
+	if(rejection && rejection->rejected()) return;
+
+	fgiven[p.index() / 64] |= 1ULL << (p.index() % 64);
+	if(fmatched) fmatched->push_back(&p);
+}
+
+void OptionsParser::unmarkGiven(const Parameter& p) {
+	fgiven[p.index() / 64] &= ~(1ULL << (p.index() % 64));
+}
+
+bool OptionsParser::wasGiven(const Parameter& p) const {
+	if(p.index() / 64 >= fgiven.size()) return false;
+	return (fgiven[p.index() / 64] >> (p.index() % 64)) & 1;
+}
+
+void OptionsParser::reset() {
+	clearFiles();
+	fgiven.clear();
+
+	for(set<Parameter*>::iterator i = parameters.parameters.begin();
+			i != parameters.parameters.end(); i++)
+	{
+		(*i)->reset();
+	}
+}
+
+void OptionsParser::buildIndex() {
+	fill(fshortIndex, fshortIndex + 256, 0);
+
+	frequired.assign((parameters.size() + 63) / 64, 0);
+	const vector<Parameter*>& ordered = parameters.ordered();
+	for(size_t i = 0; i < ordered.size(); i++) {
+		if(ordered[i]->isRequired()) frequired[i / 64] |= 1ULL << (i % 64);
+	}
+
+	/* Walk the set in the same order as the receive() loop, so that the
+	 * first parameter claiming a short option wins just like before.
+	 */
+	for(set<Parameter*>::iterator i = parameters.parameters.begin();
+			i != parameters.parameters.end(); i++)
+	{
+		uint16_t &slot = fshortIndex[(unsigned char) (*i)->shortOption()];
+		if(!slot && (*i)->decodesShortOption() && (*i)->index() < UINT16_MAX) slot = (*i)->index() + 1;
+	}
+
+	if(flongIndexed != parameters.size()) {
+		vector<const char*> names;
+		unordered_set<string> seen;
+
+		flongParameters.clear();
+		fpolled.clear();
+		for(set<Parameter*>::iterator i = parameters.parameters.begin();
+				i != parameters.parameters.end(); i++)
+		{
+			const string& name = (*i)->longOption();
+			if(!(*i)->decodesShortOption() || name.empty() || (*i)->index() >= UINT16_MAX) {
+				fpolled.push_back((*i)->index());
+			}
+			if(!(*i)->decodesShortOption() || name.empty() || !seen.insert(name).second) continue;
+
+			names.push_back(name.c_str());
+			flongParameters.push_back((*i)->index());
+		}
+
+		flongIndex.build(names, false);
+		flongIndexed = parameters.size();
+	}
+}
+
+Parameter* OptionsParser::shortIndex(char c) const {
+	uint16_t i = fshortIndex[(unsigned char) c];
+	return i ? parameters.fordered[i - 1] : NULL;
+}
+
+bool OptionsParser::receiveShortCluster(ParserState& state, ParseErrors* errors) GETOPTPP_THROW(runtime_error) {
+	const string& arg = state.get();
+
+	if(arg.length() < 2 || arg[0] != '-' || arg[1] == '-') return false;
+	if(!shortIndex(arg[1])) return false;
+
+	for(string::size_type pos = 1; pos < arg.length(); pos++) {
+		Parameter *p = shortIndex(arg[pos]);
+
+		if(!p) {
+			string what = string("Bad parameter: -") + arg[pos];
+			if(!errors) throw Parameter::ParameterRejected(what);
+
+			errors->add(ParseError::UNKNOWN_OPTION, state.position(), NULL, what);
+			break;
+		}
+
+		fcurrent = p;
+
+		if(!p->takesArgument()) {
+			p->receiveShort(NULL);
+			markGiven(*p);
+			continue;
+		}
+
+		if(pos + 1 < arg.length()) { /* -xvfarchive */
+			fargument.assign(arg, pos + 1, string::npos);
+			p->receiveShort(&fargument);
+		} else if(state.iterator + 1 != state.arguments.end()) { /* -xvf archive */
+			const string& argument = state.peek();
+			state.advance();
+			p->receiveShort(&argument);
+		} else { /* -xvf at the end of argv */
+			p->receiveShort(NULL);
+		}
+		markGiven(*p);
+		break;
+	}
+
+	return true;
+}
+
+bool OptionsParser::receiveLongOption(ParserState& state) GETOPTPP_THROW(runtime_error) {
+	const string& arg = state.get();
+
+	if(arg.length() < 3 || arg[0] != '-' || arg[1] != '-') return false;
+
+	string::size_type eq = arg.find('=', 2);
+	long i = flongIndex.find(arg.data() + 2, (eq == string::npos ? arg.length() : eq) - 2);
+	if(i < 0) return false;
+
+	Parameter* p = parameters.fordered[flongParameters[i]];
+	fcurrent = p;
+
+	if(eq == string::npos) {
+		p->receiveLong(NULL);
+	} else {
+		fargument.assign(arg, eq + 1, string::npos);
+		p->receiveLong(&fargument);
+	}
+	markGiven(*p);
+	return true;
+}
+
+/*
+ * Snapshots are laid out as follows, all integers in native byte order, so
+ * a snapshot is only read on the architecture (and build) that took it; on
+ * another byte order the schema hash doesn't match and it is rejected:
+ *
+ *	"GOPPSNP1", schema hash (64 bits), parameter count, file count (32 bits each),
+ *	total length (64 bits), program name
+ *	per parameter: switch state (8 bits), has value (8 bits), value
+ *	per file: name
+ *
+ * where names and values are prefixed with their length (32 bits).
+ */
+
+static const char snapshotMagic[8] = { 'G', 'O', 'P', 'P', 'S', 'N', 'P', '1' };
+static const size_t snapshotHeaderLength = 8 + 8 + 4 + 4 + 8;
+
+template<typename I>
+static void appendInteger(string& out, I value) {
+	out.append((const char*) &value, sizeof(value));
+}
+
+static void appendString(string& out, const string& s) {
+	appendInteger<uint32_t>(out, s.length());
+	out.append(s);
+}
+
+/* Bounds checked reading of a snapshot */
+class SnapshotReader {
+public:
+	SnapshotReader(const char* data, size_t length) : fdata(data), fleft(length) {}
+
+	template<typename I>
+	I integer() {
+		I value;
+		memcpy(&value, take(sizeof(value)), sizeof(value));
+		return value;
+	}
+
+	/* Returns the bytes of a length-prefixed string */
+	const char* bytes(uint32_t& length) {
+		length = integer<uint32_t>();
+		return take(length);
+	}
+
+	size_t left() const { return fleft; }
+private:
+	const char* take(size_t n) {
+		if(n > fleft) throw OptionsParser::InvalidSnapshot("snapshot is truncated");
+		const char* p = fdata;
+		fdata += n;
+		fleft -= n;
+		return p;
+	}
+
+	const char* fdata;
+	size_t fleft;
+};
+
+uint64_t OptionsParser::schemaHash() const {
+	uint64_t h = 14695981039346656037ULL;
+	const vector<Parameter*>& ordered = parameters.ordered();
+
+	for(vector<Parameter*>::const_iterator i = ordered.begin(); i != ordered.end(); i++) {
+		string key = string(typeid(**i).name()) + '\0' + (*i)->shortOption() + (*i)->longOption() + '\0';
+		for(string::const_iterator c = key.begin(); c != key.end(); c++) {
+			h = (h ^ (unsigned char) *c) * 1099511628211ULL;
+		}
+	}
+	return h;
+}
+
+void OptionsParser::snapshot(string& out) const {
+	size_t start = out.size();
+	const vector<Parameter*>& ordered = parameters.ordered();
+
+	out.append(snapshotMagic, sizeof(snapshotMagic));
+	appendInteger<uint64_t>(out, schemaHash());
+	appendInteger<uint32_t>(out, ordered.size());
+	appendInteger<uint32_t>(out, fileCount());
+	appendInteger<uint64_t>(out, 0); /* total length, filled in below */
+	appendString(out, argv0);
+
+	for(vector<Parameter*>::const_iterator i = ordered.begin(); i != ordered.end(); i++) {
+		appendInteger<uint8_t>(out, (*i)->switchState());
+
+		size_t at = out.size();
+		appendInteger<uint8_t>(out, 0);
+		appendInteger<uint32_t>(out, 0);
+
+		if((*i)->saveValue(out)) {
+			uint32_t length = out.size() - at - 5;
+			out[at] = 1;
+			memcpy(&out[at + 1], &length, sizeof(length));
+		}
+	}
+
+	for(size_t i = 0; i < fileCount(); i++) {
+		size_t n;
+		const char* name = file(i, n);
+		appendString(out, string(name, n));
+	}
+
+	uint64_t total = out.size() - start;
+	memcpy(&out[start + snapshotHeaderLength - 8], &total, sizeof(total));
+}
+
+void OptionsParser::restore(const char* data, size_t length) {
+	const vector<Parameter*>& ordered = parameters.ordered();
+	SnapshotView view(*this, data, length);
+
+	/* Decode every value before changing anything, so that a damaged
+	 * snapshot leaves the parser as it was */
+	size_t n;
+	const char* bytes;
+	for(size_t i = 0; i < ordered.size(); i++) {
+		bytes = view.value(i, n);
+		if(bytes && !ordered[i]->canRestoreValue(bytes, n, view.switchState(i))) {
+			throw InvalidSnapshot("--" + ordered[i]->longOption() + ": malformed value in snapshot");
+		}
+	}
+
+	bytes = view.programName(n);
+	argv0.assign(bytes, n);
+
+	fgiven.assign((ordered.size() + 63) / 64, 0);
+	for(size_t i = 0; i < ordered.size(); i++) {
+		unsigned state = view.switchState(i);
+		bytes = view.value(i, n);
+
+		ordered[i]->restoreSwitchState(state);
+		if(bytes && !ordered[i]->restoreValue(bytes, n)) {
+			throw InvalidSnapshot("--" + ordered[i]->longOption() + ": malformed value in snapshot");
+		}
+		if(state & Parameter::STATE_SET) markGiven(*ordered[i]);
+	}
+
+	clearFiles();
+	for(size_t i = 0; i < view.fileCount(); i++) {
+		bytes = view.file(i, n);
+		addFile(bytes, n);
+	}
+}
+
+/*
+ *
+ * Class SnapshotView
+ *
+ *
+ */
+
+SnapshotView::SnapshotView(const OptionsParser& schema, const char* data, size_t length) {
+	SnapshotReader in(data, length);
+	if(length < sizeof(snapshotMagic) || memcmp(data, snapshotMagic, sizeof(snapshotMagic))) {
+		throw OptionsParser::InvalidSnapshot("not a snapshot");
+	}
+	in.integer<uint64_t>(); /* the magic */
+
+	uint64_t hash = in.integer<uint64_t>();
+	uint32_t parameterCount = in.integer<uint32_t>();
+	if(hash != schema.schemaHash() || parameterCount != schema.parameters.size()) {
+		throw OptionsParser::InvalidSnapshot("snapshot was taken with different parameters");
+	}
+	uint32_t fileCount = in.integer<uint32_t>();
+	if(in.integer<uint64_t>() != length || fileCount > length / sizeof(uint32_t)) {
+		throw OptionsParser::InvalidSnapshot("snapshot has the wrong length");
+	}
+
+	fprogramName.first = in.bytes(fprogramName.second);
+
+	frecords.resize(parameterCount);
+	for(uint32_t i = 0; i < parameterCount; i++) {
+		frecords[i].state = in.integer<uint8_t>();
+		bool hasValue = in.integer<uint8_t>();
+		frecords[i].value = in.bytes(frecords[i].length);
+		if(!hasValue) frecords[i].value = NULL;
+	}
+
+	ffiles.resize(fileCount);
+	for(uint32_t i = 0; i < fileCount; i++) ffiles[i].first = in.bytes(ffiles[i].second);
+
+	if(in.left()) throw OptionsParser::InvalidSnapshot("snapshot has trailing data");
+}
+
+size_t SnapshotView::size() const { return frecords.size(); }
+
+unsigned SnapshotView::switchState(size_t index) const {
+	return frecords.at(index).state;
+}
+
+const char* SnapshotView::value(size_t index, size_t& length) const {
+	const Record& r = frecords.at(index);
+	length = r.length;
+	return r.value;
+}
+
+const char* SnapshotView::programName(size_t& length) const {
+	length = fprogramName.second;
+	return fprogramName.first;
+}
+
+size_t SnapshotView::fileCount() const { return ffiles.size(); }
+
+const char* SnapshotView::file(size_t i, size_t& length) const {
+	length = ffiles.at(i).second;
+	return ffiles.at(i).first;
+}
+
+MemoryUsage OptionsParser::memoryUsage() const {
+	MemoryUsage usage;
+
+	usage.parser = sizeof(*this) + MemoryUsage::heap(argv0) + MemoryUsage::heap(fprogramDesc);
+	usage.parser += (fgiven.capacity() + frequired.capacity()) * sizeof(uint64_t);
+	usage.parser += ftokens.capacity() * sizeof(string) + MemoryUsage::heap(fargument);
+	for(size_t i = 0; i < ftokens.size(); i++) usage.parser += MemoryUsage::heap(ftokens[i]);
+	usage.parser += flongIndex.memoryUsage() + (flongParameters.capacity() + fpolled.capacity()) * sizeof(uint32_t);
+
+	parameters.memoryUsage(usage);
+
+	usage.files = files.capacity() * sizeof(string);
+	for(size_t i = 0; i < files.size(); i++) usage.files += MemoryUsage::heap(files[i]);
+	usage.files += ffileEntries.capacity() * sizeof(FileEntry);
+	for(size_t i = 0; i < ffileEntries.size(); i++) usage.files += ffileEntries[i].length + 1;
+
+	/* Each node of the set holds its string and a link, besides the bucket array */
+	if(fglobSeen) {
+		usage.files += sizeof(GlobSeen) + fglobSeen->bucket_count() * sizeof(void*);
+		for(GlobSeen::const_iterator i = fglobSeen->begin(); i != fglobSeen->end(); i++) {
+			usage.files += sizeof(void*) + sizeof(string) + MemoryUsage::heap(*i);
+		}
+	}
+
+	return usage;
+}
+
+void OptionsParser::usage() const {
+	FileSink out(stderr);
+	usage(out);
+}
+
+void OptionsParser::usage(OutputSink& out) const {
+	string text = "Usage: " + programName() + " arguments\n";
+	text += fprogramDesc;
+	text += "\n\nParameters: \n";
+
+	set<Parameter*>::iterator i;
+	for(i = parameters.parameters.begin();
+			i != parameters.parameters.end(); i++)
+	{
+		/* Columns of 30 and 40, as the iostream version laid them out with width() */
+		size_t start = text.length();
+		text += "    " + (*i)->usageLine();
+		if(text.length() - start < 30) text.append(start + 30 - text.length(), ' ');
+
+		start = text.length();
+		text += (*i)->description();
+		if(text.length() - start < 40) text.append(start + 40 - text.length(), ' ');
+		text += '\n';
+	}
+
+	out.write(text.data(), text.length());
+}
+
+/*
+ *
+ * Class DeferredValidation
+ *
+ *
+ */
+
+static thread_local DeferredValidation* activeValidation = NULL;
+
+DeferredValidation::Job::Job(const Parameter& parameter) :
+	fparameter(parameter), fposition(-1), flongForm(false), ffailed(false), fkind(ParseError::BAD_VALUE) {}
+
+DeferredValidation::Job::~Job() {}
+
+void DeferredValidation::Job::reject() {}
+
+void DeferredValidation::Job::execute() {
+	/* Turn what run() throws into what receive() or receiveShort() would have
+	 * made of it, had the argument been validated during the scan. */
+	string name = flongForm ? "--" + fparameter.longOption() : string("-") + fparameter.shortOption();
+
+	try {
+		run();
+		return;
+	} catch(Parameter::ExpectedArgument &e) {
+		fkind = ParseError::MISSING_ARGUMENT;
+		fwhat = name + ": expected an argument";
+	} catch(Parameter::UnexpectedArgument &e) {
+		fkind = ParseError::UNEXPECTED_ARGUMENT;
+		fwhat = name + ": did not expect an argument";
+	} catch(Switchable::SwitchingError &e) {
+		fkind = ParseError::DUPLICATE_OPTION;
+		fwhat = name + ": parameter already set";
+	} catch(Parameter::ParameterRejected &e) {
+		fkind = !flongForm && dynamic_cast<Parameter::AlreadySet*>(&e) ? ParseError::DUPLICATE_OPTION : ParseError::BAD_VALUE;
+		fwhat = rejectedMessage(fparameter, flongForm, e.what());
+		if(fkind == ParseError::BAD_VALUE) {
+			try {
+				e.rethrow(fwhat);
+			} catch(...) {
+				frejection = std::current_exception();
+			}
+		}
+	} catch(...) {
+		fexception = std::current_exception();
+	}
+
+	ffailed = true;
+}
+
+DeferredValidation::DeferredValidation(unsigned threads) :
+	fthreads(threads), fprevious(activeValidation), fposition(-1), flongForm(false),
+	ffailed(0), freplayed(-1)
+{
+	if(fthreads) activeValidation = this;
+}
+
+DeferredValidation::~DeferredValidation() {
+	if(fthreads) activeValidation = fprevious;
+
+	for(size_t i = 0; i < fjobs.size(); i++) delete fjobs[i];
+}
+
+DeferredValidation* DeferredValidation::active() {
+	return activeValidation;
+}
+
+void DeferredValidation::at(int position, const string& argument) {
+	fposition = position;
+	flongForm = argument.compare(0, 2, "--") == 0;
+}
+
+void DeferredValidation::add(Job* job) {
+	job->fposition = fposition;
+	job->flongForm = flongForm;
+
+	if(freplayed == (size_t) -1) {
+		fjobs.push_back(job);
+		return;
+	}
+
+	/* Replaying: the same arguments come in the same order as in the first scan */
+	if(freplayed < ffailed) {
+		delete job;
+		fjobs[freplayed++]->apply();
+		return;
+	}
+
+	struct Owner {
+		Job* job;
+		~Owner() { delete job; }
+	} owner = { job };
+
+	try {
+		job->run();
+	} catch(...) {
+		job->reject();
+		throw;
+	}
+	job->apply();
+}
+
+bool DeferredValidation::replay() {
+	if(freplayed != (size_t) -1 || ffailed == fjobs.size()) return false;
+
+	freplayed = 0;
+	return true;
+}
+
+void DeferredValidation::finish(ParseErrors* errors, vector<const Parameter*>* rejected) {
+	/* Replayed jobs are applied as they are added */
+	if(freplayed != (size_t) -1) return;
+
+	vector<Job*>& jobs = fjobs;
+	ffailed = jobs.size();
+	if(jobs.empty()) return;
+
+	/* The calling thread works too, so a pool that can't be started only slows things down */
+	std::atomic<size_t> next(0);
+	auto work = [&jobs, &next]() {
+		for(size_t i; (i = next++) < jobs.size(); ) jobs[i]->execute();
+	};
+
+	vector<std::thread> pool;
+	size_t threads = min<size_t>(fthreads, jobs.size());
+	for(size_t i = 1; i < threads; i++) {
+		try {
+			pool.push_back(std::thread(work));
+		} catch(std::system_error &e) {
+			break;
+		}
+	}
+	work();
+	for(size_t i = 0; i < pool.size(); i++) pool[i].join();
+
+	vector<ParseError> found;
+	for(size_t i = 0; i < jobs.size(); i++) {
+		Job& job = *jobs[i];
+
+		if(!job.ffailed) {
+			job.apply();
+			continue;
+		}
+
+		if(job.fexception || !errors) {
+			/* A serial parse would have stopped here, so nothing after is applied */
+			ffailed = i;
+			for(size_t j = jobs.size(); j-- > i; ) {
+				jobs[j]->reject();
+				if(rejected) rejected->push_back(&jobs[j]->fparameter);
+			}
+			break;
+		}
+
+		job.reject();
+		if(rejected) rejected->push_back(&job.fparameter);
+
+		ParseError e;
+		e.kind = job.fkind;
+		e.position = job.fposition;
+		e.parameter = &job.fparameter;
+		e.message = job.fwhat;
+		found.push_back(e);
+	}
+
+	if(ffailed < jobs.size()) {
+		Job& job = *jobs[ffailed];
+		if(job.fexception) std::rethrow_exception(job.fexception);
+
+		switch(job.fkind) {
+			case ParseError::MISSING_ARGUMENT: throw Parameter::ExpectedArgument(job.fwhat);
+			case ParseError::UNEXPECTED_ARGUMENT: throw Parameter::UnexpectedArgument(job.fwhat);
+			case ParseError::DUPLICATE_OPTION: throw Parameter::AlreadySet(job.fwhat);
+			default: std::rethrow_exception(job.frejection);
+		}
+	}
+
+	if(errors) errors->merge(found);
+}
+
+/*
+ *
+ * Class RejectedArgument
+ *
+ *
+ */
+
+static thread_local RejectedArgument* activeRejection = NULL;
+
+RejectedArgument::RejectedArgument(bool collect) :
+	fcollect(collect), fprevious(activeRejection), frejected(false)
+{
+	if(fcollect) activeRejection = this;
+}
+
+RejectedArgument::~RejectedArgument() {
+	if(fcollect) activeRejection = fprevious;
+}
+
+RejectedArgument* RejectedArgument::active() {
+	return activeRejection;
+}
+
+void RejectedArgument::reject(const string& what) {
+	frejected = true;
+	fwhat = what;
+}
+
+bool RejectedArgument::rejected() const { return frejected; }
+const string& RejectedArgument::what() const { return fwhat; }
+
+/*
+ *
+ * Struct MemoryUsage
+ *
+ *
+ */
+
+MemoryUsage::MemoryUsage() :
+	parser(0), parameters(0), names(0), descriptions(0), values(0), index(0), constraints(0), files(0) {}
+
+size_t MemoryUsage::total() const {
+	return parser + parameters + names + descriptions + values + index + constraints + files;
+}
+
+size_t MemoryUsage::heap(const string& s) {
+	/* Short strings are held inside the string object itself */
+	static const size_t inlineCapacity = string().capacity();
+	return s.capacity() > inlineCapacity ? s.capacity() + 1 : 0;
+}
+
+/*
+ *
+ * Memory resources
+ *
+ *
+ */
+
+namespace {
+
+class NewDeleteResource : public MemoryResource {
+public:
+	virtual void* allocate(size_t bytes, size_t alignment) {
+#ifdef __cpp_aligned_new
+		if(alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) return ::operator new(bytes, std::align_val_t(alignment));
+#else
+		(void) alignment;
+#endif
+		return ::operator new(bytes);
+	}
+
+	virtual void deallocate(void* p, size_t, size_t alignment) {
+#ifdef __cpp_aligned_new
+		if(alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+			::operator delete(p, std::align_val_t(alignment));
+			return;
+		}
+#else
+		(void) alignment;
+#endif
+		::operator delete(p);
+	}
+};
+
+}
+
+MemoryResource* MemoryResource::newDelete() {
+	static NewDeleteResource resource;
+	return &resource;
+}
+
+MonotonicResource::MonotonicResource(MemoryResource* upstream) :
+	fupstream(upstream), fbuffer(NULL), fbufferSize(0), fnext(NULL), fleft(0),
+	fblocks(NULL), fblockSize(1024), fused(0) {}
+
+MonotonicResource::MonotonicResource(void* buffer, size_t size, MemoryResource* upstream) :
+	fupstream(upstream), fbuffer(static_cast<char*>(buffer)), fbufferSize(size),
+	fnext(static_cast<char*>(buffer)), fleft(size), fblocks(NULL), fblockSize(size < 1024 ? 1024 : size), fused(0) {}
+
+MonotonicResource::~MonotonicResource() {
+	release();
+}
+
+void* MonotonicResource::allocate(size_t bytes, size_t alignment) {
+	size_t padding = (alignment - reinterpret_cast<uintptr_t>(fnext) % alignment) % alignment;
+
+	if(!fnext || padding + bytes > fleft) {
+		/* Blocks grow geometrically, so that a large parse only takes a few of them */
+		while(fblockSize < bytes + alignment) fblockSize *= 2;
+
+		size_t size = sizeof(Block) + fblockSize;
+		Block* block = static_cast<Block*>(fupstream->allocate(size, alignof(max_align_t)));
+		block->next = fblocks;
+		block->size = size;
+		fblocks = block;
+
+		fnext = reinterpret_cast<char*>(block + 1);
+		fleft = fblockSize;
+		fblockSize *= 2;
+
+		padding = (alignment - reinterpret_cast<uintptr_t>(fnext) % alignment) % alignment;
+	}
+
+	char* p = fnext + padding;
+	fnext = p + bytes;
+	fleft -= padding + bytes;
+	fused += bytes;
+	return p;
+}
+
+void MonotonicResource::deallocate(void*, size_t, size_t) {}
+
+void MonotonicResource::release() {
+	while(fblocks) {
+		Block* next = fblocks->next;
+		fupstream->deallocate(fblocks, fblocks->size, alignof(max_align_t));
+		fblocks = next;
+	}
+
+	fnext = fbuffer;
+	fleft = fbufferSize;
+	fused = 0;
+}
+
+size_t MonotonicResource::used() const {
+	return fused;
+}
+
 /*
  *
- * Class OptionsParser
+ * Output sinks
  *
  *
  */
 
+FileSink::FileSink(FILE* file) : ffile(file) {}
 
-OptionsParser::OptionsParser(const char* programDesc) : fprogramDesc(programDesc) {}
-OptionsParser::~OptionsParser() {}
+void FileSink::write(const char* data, size_t length) {
+	fwrite(data, 1, length, ffile);
+}
 
-ParameterSet& OptionsParser::getParameters() {
-	return parameters;
+#if defined(__unix__) || defined(__APPLE__)
+FdSink::FdSink(int fd) : ffd(fd) {}
+
+void FdSink::write(const char* data, size_t length) {
+	while(length) {
+		ssize_t n = ::write(ffd, data, length);
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			return;
+		}
+		data += n;
+		length -= n;
+	}
 }
+#endif
 
-void OptionsParser::parse(int argc, const char* argv[]) throw(runtime_error)
+BufferSink::BufferSink(char* buffer, size_t capacity) :
+	fbuffer(buffer), fcapacity(capacity), flength(0), ftruncated(false)
 {
-	argv0 = argv[0];
+	if(fcapacity) fbuffer[0] = 0;
+}
+
+void BufferSink::write(const char* data, size_t length) {
+	size_t room = fcapacity ? fcapacity - 1 - flength : 0;
+	if(length > room) {
+		length = room;
+		ftruncated = true;
+	}
+	memcpy(fbuffer + flength, data, length);
+	flength += length;
+	if(fcapacity) fbuffer[flength] = 0;
+}
 
-	if(argc == 1) return;
+size_t BufferSink::length() const { return flength; }
+bool BufferSink::truncated() const { return ftruncated; }
 
-	vector<string> v(&argv[1], &argv[argc]);
+CallbackSink::CallbackSink(Callback callback, void* context) : fcallback(callback), fcontext(context) {}
 
-	ParserState state(*this, v);
+void CallbackSink::write(const char* data, size_t length) {
+	fcallback(data, length, fcontext);
+}
 
-	for(; !state.end(); state.advance()) {
+/*
+ *
+ * Class ParameterGroup
+ *
+ *
+ */
 
-		set<Parameter*>::iterator i;
+ParameterGroup::ParameterGroup() {}
+ParameterGroup::ParameterGroup(Parameter& p) : fmembers(1, &p) {}
 
-		for(i = parameters.parameters.begin();
-				i != parameters.parameters.end(); i++)
-		{
-			if((*i)->receive(state)) break;
-		}
+ParameterGroup& ParameterGroup::add(Parameter& p) {
+	fmembers.push_back(&p);
+	return *this;
+}
 
-		if(i == parameters.parameters.end()) {
-			string file = state.get();
-			if(file == "--") {
-				state.advance();
-				break;
-			}
-			else if(file.at(0) == '-')
-				throw Parameter::ParameterRejected(string("Bad parameter: ") + file);
-			else files.push_back(state.get());
-		}
-	}
+const vector<Parameter*>& ParameterGroup::members() const { return fmembers; }
 
-	if(!state.end()) for(; !state.end(); state.advance()) {
-		files.push_back(state.get());
-	}
+/*
+ *
+ * Class ParseErrors
+ *
+ *
+ */
 
-}
+ParseErrors::ParseErrors(size_t capacity) : ferrors(capacity), fcount(0) {}
 
-void OptionsParser::usage() const {
-	cerr << "Usage: " << programName() << " arguments" << endl;
+void ParseErrors::clear() { fcount = 0; }
+size_t ParseErrors::size() const { return fcount; }
+bool ParseErrors::empty() const { return fcount == 0; }
+bool ParseErrors::full() const { return fcount == ferrors.size(); }
 
-	cerr << fprogramDesc << endl << endl;
+const ParseError& ParseErrors::operator[](size_t i) const {
+	if(i >= fcount) throw out_of_range("ParseErrors[]");
+	return ferrors[i];
+}
 
-	cerr << "Parameters: " << endl;
+void ParseErrors::add(ParseError::Kind kind, int position, const Parameter* parameter, const string& message) {
+	if(full()) return;
 
-	set<Parameter*>::iterator i;
-	for(i = parameters.parameters.begin();
-			i != parameters.parameters.end(); i++)
-	{
-		cerr.width(30);
-		cerr << left << "    " + (*i)->usageLine();
+	/* Assigning (rather than replacing) the message reuses its storage */
+	ParseError& e = ferrors[fcount++];
+	e.kind = kind;
+	e.position = position;
+	e.parameter = parameter;
+	e.message.assign(message);
+}
 
-		cerr.width(40);
-		cerr << left << (*i)->description() << endl;
+void ParseErrors::merge(const vector<ParseError>& errors) {
+	if(errors.empty()) return;
+
+	/* Both lists are in argv order, with the errors not tied to an argument
+	 * last. They are merged from the back, so that every error moves at most
+	 * once, into the storage of one not yet moved; those that don't fit are
+	 * the latest ones, and are dropped. */
+	size_t total = fcount + errors.size();
+	size_t kept = min(total, ferrors.size());
+	size_t i = fcount, j = errors.size();
+
+	for(size_t k = total; k-- > 0; ) {
+		/* On equal positions the errors already listed come first */
+		bool fromErrors = i == 0 || (j > 0 && (unsigned) errors[j-1].position >= (unsigned) ferrors[i-1].position);
+		if(fromErrors) j--;
+		else i--;
+
+		if(k >= kept) continue;
+		if(!fromErrors) {
+			if(k == i) break;
+			std::swap(ferrors[k], ferrors[i]);
+			continue;
+		}
 
+		ParseError& e = ferrors[k];
+		e.kind = errors[j].kind;
+		e.position = errors[j].position;
+		e.parameter = errors[j].parameter;
+		e.message.assign(errors[j].message);
 	}
-
+	fcount = kept;
 }
 
 const vector<string>& OptionsParser::getFiles() const {
+	if(ffilesStale) {
+		files.clear();
+		for(size_t i = 0; i < ffileEntries.size(); i++) {
+			files.push_back(string(ffileEntries[i].name, ffileEntries[i].length));
+		}
+		ffilesStale = false;
+	}
 	return files;
 }
 
+size_t OptionsParser::fileCount() const {
+	return fresource ? ffileEntries.size() : files.size();
+}
+
+const char* OptionsParser::file(size_t i, size_t& length) const {
+	if(fresource) {
+		length = ffileEntries.at(i).length;
+		return ffileEntries[i].name;
+	}
+	length = files.at(i).size();
+	return files[i].c_str();
+}
+
 const string& OptionsParser::programName() const {
 	return argv0;
 }
@@ -113,6 +1191,41 @@ ParameterSet::ParameterSet(const ParameterSet& ps) {
 	throw new runtime_error("ParameterSet not copyable");
 }
 
+size_t ParameterSet::size() const {
+	return fordered.size();
+}
+
+const vector<Parameter*>& ParameterSet::ordered() const {
+	return fordered;
+}
+
+/* The bytes of a pooled string, the first time the set uses it */
+static size_t pooledBytes(const string* s, unordered_set<const string*>& seen) {
+	if(s->empty() || !seen.insert(s).second) return 0;
+	return sizeof(InternedString::Entry) + MemoryUsage::heap(*s);
+}
+
+void ParameterSet::memoryUsage(MemoryUsage& usage) const {
+	unordered_set<const string*> seen;
+	for(size_t i = 0; i < fordered.size(); i++) {
+		const Parameter* p = fordered[i];
+		usage.parameters += p->objectSize();
+		usage.names += pooledBytes(p->flongOption, seen);
+		usage.descriptions += pooledBytes(p->fdescription, seen);
+		usage.values += p->valueMemory();
+	}
+
+	/* A red-black tree node is three pointers and a color, then the element */
+	usage.index += parameters.size() * (4 * sizeof(void*) + sizeof(Parameter*));
+	usage.index += fordered.capacity() * sizeof(Parameter*);
+
+	usage.constraints += fconstraints.capacity() * sizeof(Constraint);
+	for(size_t i = 0; i < fconstraints.size(); i++) {
+		usage.constraints += fconstraints[i].first.capacity() * sizeof(Mask::value_type);
+		usage.constraints += fconstraints[i].second.capacity() * sizeof(Mask::value_type);
+	}
+}
+
 ParameterSet::~ParameterSet() {
 	for(set<Parameter*>::iterator i = parameters.begin();
 			i != parameters.end(); i++)
@@ -122,10 +1235,279 @@ ParameterSet::~ParameterSet() {
 
 }
 
+ParameterSet::Mask ParameterSet::compile(const ParameterGroup& group) const {
+	vector<uint64_t> bits((fordered.size() + 63) / 64, 0);
+
+	const vector<Parameter*>& members = group.members();
+	for(vector<Parameter*>::const_iterator i = members.begin(); i != members.end(); i++) {
+		size_t index = (*i)->index();
+		if(index >= fordered.size() || fordered[index] != *i) {
+			throw logic_error("--" + (*i)->longOption() + " is not in this ParameterSet");
+		}
+		bits[index / 64] |= 1ULL << (index % 64);
+	}
+
+	Mask mask;
+	for(size_t w = 0; w < bits.size(); w++) {
+		if(bits[w]) mask.push_back(make_pair(w, bits[w]));
+	}
+	return mask;
+}
+
+void ParameterSet::requireAny(const ParameterGroup& group) {
+	Constraint c;
+	c.kind = Constraint::ANY;
+	c.first = compile(group);
+	fconstraints.push_back(c);
+}
+
+void ParameterSet::exclusive(const ParameterGroup& group) {
+	Constraint c;
+	c.kind = Constraint::AT_MOST_ONE;
+	c.first = compile(group);
+	fconstraints.push_back(c);
+}
+
+void ParameterSet::depends(const ParameterGroup& dependent, const ParameterGroup& dependency) {
+	Constraint c;
+	c.kind = Constraint::DEPENDS;
+	c.first = compile(dependent);
+	c.second = compile(dependency);
+	fconstraints.push_back(c);
+}
+
+/* Words past the end of a bitset count as zero, as the set may have grown since */
+static inline uint64_t word(const vector<uint64_t>& bits, size_t w) {
+	return w < bits.size() ? bits[w] : 0;
+}
+
+/* The index of the lowest set bit of a non-zero word */
+static inline int lowestBit(uint64_t w) {
+#if defined(__GNUC__)
+	return __builtin_ctzll(w);
+#else
+	int n = 0;
+	for(; !(w & 1); w >>= 1) n++;
+	return n;
+#endif
+}
+
+static inline int bitCount(uint64_t w) {
+#if defined(__GNUC__)
+	return __builtin_popcountll(w);
+#else
+	int n = 0;
+	for(; w; w &= w - 1) n++;
+	return n;
+#endif
+}
+
+void ParameterSet::select(const Mask& mask, const vector<uint64_t>& bits, bool set,
+		vector<const Parameter*>& selected, string& names) const
+{
+	for(Mask::const_iterator m = mask.begin(); m != mask.end(); m++) {
+		uint64_t w = set ? word(bits, m->first) : ~word(bits, m->first);
+
+		for(uint64_t b = m->second & w; b; b &= b - 1) {
+			const Parameter* p = fordered[m->first * 64 + lowestBit(b)];
+			selected.push_back(p);
+			names += (names.empty() ? "--" : ", --") + p->longOption();
+		}
+	}
+}
+
+void ParameterSet::violation(int kind, const string& message,
+		const vector<const Parameter*>& involved, ParseErrors* errors) const
+{
+	if(errors) {
+		errors->add((ParseError::Kind) kind, -1, involved.empty() ? NULL : involved[0], message);
+	} else if(kind == ParseError::MISSING_REQUIRED) {
+		throw Parameter::MissingRequired(message, involved);
+	} else {
+		throw Parameter::ConstraintViolation(message, involved);
+	}
+}
+
+void ParameterSet::checkConstraints(const vector<uint64_t>& given, const vector<uint64_t>& required,
+		ParseErrors* errors) const GETOPTPP_THROW(runtime_error)
+{
+	for(size_t w = 0; w < required.size(); w++) {
+		if(!(required[w] & ~word(given, w))) continue;
+
+		Mask all;
+		for(w = 0; w < required.size(); w++) all.push_back(make_pair(w, required[w]));
+
+		vector<const Parameter*> involved;
+		string names;
+		select(all, given, false, involved, names);
+		violation(ParseError::MISSING_REQUIRED, names + ": required parameter not given", involved, errors);
+		break;
+	}
+
+	for(vector<Constraint>::const_iterator c = fconstraints.begin(); c != fconstraints.end(); c++) {
+		if(errors && errors->full()) return;
+
+		int count = 0;
+		for(Mask::const_iterator m = c->first.begin(); m != c->first.end(); m++) {
+			count += bitCount(m->second & word(given, m->first));
+		}
+
+		bool violated = false;
+		switch(c->kind) {
+		case Constraint::ANY:
+			violated = (count == 0);
+			break;
+		case Constraint::AT_MOST_ONE:
+			violated = (count > 1);
+			break;
+		case Constraint::DEPENDS:
+			if(count == 0) break;
+			for(Mask::const_iterator m = c->second.begin(); m != c->second.end(); m++) {
+				violated |= ((m->second & word(given, m->first)) != m->second);
+			}
+			break;
+		}
+		if(!violated) continue;
+
+		/* Only now is it worth spelling out who is involved */
+		vector<const Parameter*> involved;
+		string names, others;
+
+		switch(c->kind) {
+		case Constraint::ANY:
+			select(c->first, given, false, involved, names);
+			violation(ParseError::MISSING_REQUIRED, names + ": one of these is required", involved, errors);
+			break;
+		case Constraint::AT_MOST_ONE:
+			select(c->first, given, true, involved, names);
+			violation(ParseError::CONFLICTING_OPTIONS, names + ": can not be given together", involved, errors);
+			break;
+		case Constraint::DEPENDS:
+			select(c->first, given, true, involved, names);
+			select(c->second, given, false, involved, others);
+			violation(ParseError::MISSING_DEPENDENCY, names + ": requires " + others, involved, errors);
+			break;
+		}
+	}
+}
+
 /* The typical use case for command line arguments makes linear searching completely
  * acceptable here.
  */
 
+namespace {
+
+void writeString(OutputSink& out, const char* s) {
+	out.write(s, strlen(s));
+}
+
+/** Write s as a JSON string, quotes included */
+void writeJsonString(OutputSink& out, const char* s, size_t length) {
+	static const char hex[] = "0123456789abcdef";
+
+	out.write("\"", 1);
+
+	/* Write the runs of characters that need no escaping in one go */
+	size_t run = 0;
+	for(size_t i = 0; i < length; i++) {
+		unsigned char c = s[i];
+		if(c >= 0x20 && c != '"' && c != '\\') continue;
+
+		out.write(s + run, i - run);
+		run = i + 1;
+
+		char escape[6] = { '\\', (char) c, 0, 0, 0, 0 };
+		size_t n = 2;
+		switch(c) {
+			case '"': case '\\': break;
+			case '\n': escape[1] = 'n'; break;
+			case '\t': escape[1] = 't'; break;
+			case '\r': escape[1] = 'r'; break;
+			default:
+				escape[1] = 'u';
+				escape[2] = '0';
+				escape[3] = '0';
+				escape[4] = hex[c >> 4];
+				escape[5] = hex[c & 15];
+				n = 6;
+		}
+		out.write(escape, n);
+	}
+	out.write(s + run, length - run);
+
+	out.write("\"", 1);
+}
+
+template<typename I>
+void writeInteger(OutputSink& out, I value) {
+	char bytes[sizeof(I)];
+	memcpy(bytes, &value, sizeof(I));
+	out.write(bytes, sizeof(I));
+}
+
+void writeRecordString(OutputSink& out, const char* s, size_t length) {
+	writeInteger<uint32_t>(out, length);
+	out.write(s, length);
+}
+
+}
+
+void ParameterSet::exportConfig(OutputSink& out, ExportFormat format) const {
+	static const char* const sources[] = { "default", "preset", "command-line" };
+
+	/* Every value is formatted here, so that its buffer is only grown a few times */
+	string value;
+	value.reserve(64);
+
+	if(format == EXPORT_BINARY) {
+		out.write("GOX1", 4);
+		writeInteger<uint32_t>(out, fordered.size());
+	} else {
+		out.write("[", 1);
+	}
+
+	for(size_t i = 0; i < fordered.size(); i++) {
+		const Parameter& p = *fordered[i];
+
+		unsigned state = p.switchState();
+		unsigned source = (state & Parameter::STATE_SET) ? 2 : p.hasDefault() ? 1 : 0;
+
+		value.clear();
+		bool hasValue = p.formatArgument(value);
+
+		if(format == EXPORT_BINARY) {
+			char flags[3] = { (char) source, (char) p.isSet(), p.shortOption() };
+			out.write(flags, sizeof(flags));
+			writeRecordString(out, p.typeName(), strlen(p.typeName()));
+			writeRecordString(out, p.longOption().data(), p.longOption().size());
+			if(hasValue) writeRecordString(out, value.data(), value.size());
+			else writeInteger<uint32_t>(out, 0xffffffff);
+			continue;
+		}
+
+		writeString(out, i ? ",{\"name\":" : "{\"name\":");
+		writeJsonString(out, p.longOption().data(), p.longOption().size());
+
+		writeString(out, ",\"short\":");
+		char shortOption = p.shortOption();
+		if(shortOption) writeJsonString(out, &shortOption, 1);
+		else writeString(out, "null");
+
+		writeString(out, ",\"type\":");
+		writeJsonString(out, p.typeName(), strlen(p.typeName()));
+
+		writeString(out, ",\"value\":");
+		if(hasValue) writeJsonString(out, value.data(), value.size());
+		else writeString(out, "null");
+
+		writeString(out, ",\"source\":\"");
+		writeString(out, sources[source]);
+		writeString(out, p.isSet() ? "\",\"set\":true}" : "\",\"set\":false}");
+	}
+
+	if(format == EXPORT_JSON) out.write("]", 1);
+}
+
 Parameter& ParameterSet::operator[](char c) const {
 	for(set<Parameter*>::const_iterator i = parameters.begin(); i!= parameters.end(); i++) {
 		if((*i)->shortOption() == c) return *(*i);
@@ -151,22 +1533,24 @@ Parameter& ParameterSet::operator[](const string& param) const {
  */
 
 
-ParserState::ParserState(OptionsParser &opts, vector<string>& args) :
-	opts(opts), arguments(args), iterator(args.begin())
+ParserState::ParserState(OptionsParser &opts, vector<string>& args, int offset) :
+	opts(opts), arguments(args), iterator(args.begin()), foffset(offset)
 {
 	
 }
 
-const string ParserState::peek() const {
+static const string noArgument;
+
+const string& ParserState::peek() const {
 	vector<string>::const_iterator next = iterator+1;
 	if(next != arguments.end()) return *next;
-	else return "";
+	else return noArgument;
 	
 }
 
-const string ParserState::get() const {
+const string& ParserState::get() const {
 	if(!end()) return *iterator;
-	else return "";
+	else return noArgument;
 }
 
 void ParserState::advance() {
@@ -177,6 +1561,10 @@ bool ParserState::end() const {
 	return iterator == arguments.end();
 }
 
+int ParserState::position() const {
+	return foffset + (iterator - arguments.begin()) + 1;
+}
+
 
 /*
  *
@@ -187,18 +1575,64 @@ bool ParserState::end() const {
 
 
 
+/* The pool of long names and descriptions. It is never destroyed, so that
+ * parameters of static objects can outlive it. */
+static const string* pooled(const char* s) {
+	static InternTable* pool = new InternTable();
+	return &pool->intern(s, strlen(s)).str();
+}
+
 Parameter::Parameter(char shortOption, const char *longOption, const char *description) :
-	fshortOption(shortOption), flongOption(longOption), fdescription(description)
+	flongOption(pooled(longOption)), fdescription(pooled(description)),
+	findex(0), fshortOption(shortOption), frequired(false), fexpensive(false)
 {
 	
 }
 
 Parameter::~Parameter() {}
 
-const string& Parameter::description() const { return fdescription; }
-const string& Parameter::longOption() const { return flongOption; }
+const string& Parameter::description() const { return *fdescription; }
+
+string Parameter::usageColumns(const string& shortForm, const string& longForm) {
+	string line = shortForm;
+	if(line.length() < 10) line.append(10 - line.length(), ' ');
+	line += longForm;
+	if(longForm.length() < 20) line.append(20 - longForm.length(), ' ');
+	return line;
+}
+const string& Parameter::longOption() const { return *flongOption; }
 char Parameter::shortOption() const { return fshortOption; }
 
+bool Parameter::takesArgument() const { return false; }
+
+bool Parameter::formatArgument(string&) const { return false; }
+const char* Parameter::typeName() const { return "value"; }
+
+void Parameter::setRequired(bool required) { frequired = required; }
+bool Parameter::isRequired() const { return frequired; }
+bool Parameter::hasDefault() const { return (switchState() & STATE_PRESET) != 0; }
+void Parameter::setExpensive(bool expensive) { fexpensive = expensive; }
+bool Parameter::isExpensive() const { return fexpensive; }
+size_t Parameter::index() const { return findex; }
+size_t Parameter::objectSize() const { return sizeof(*this); }
+size_t Parameter::valueMemory() const { return 0; }
+void Parameter::reset() {}
+
+unsigned Parameter::switchState() const { return isSet() ? STATE_SET : 0; }
+void Parameter::restoreSwitchState(unsigned) {}
+bool Parameter::saveValue(string&) const { return false; }
+bool Parameter::restoreValue(const char*, size_t length) { return length == 0; }
+bool Parameter::canRestoreValue(const char*, size_t length, unsigned) const { return length == 0; }
+bool Parameter::decodesShortOption() const { return false; }
+
+void Parameter::receiveShort(const string*) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	throw ParameterRejected(string("-") + shortOption() + ": cannot be decoded as a short option");
+}
+
+void Parameter::receiveLong(const string*) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	throw ParameterRejected("--" + longOption() + ": cannot be decoded as a long option");
+}
+
 /*
  *
  * Class Switchable
@@ -209,28 +1643,47 @@ char Parameter::shortOption() const { return fshortOption; }
 bool Switchable::isSet() const { return fset; }
 Switchable::~Switchable() {};
 Switchable::Switchable() : fset(false) {}
+void Switchable::reset() { fset = false; }
+unsigned Switchable::state() const { return fset ? Parameter::STATE_SET : 0; }
+void Switchable::restoreState(unsigned state) { fset = (state & Parameter::STATE_SET) != 0; }
 
-void MultiSwitchable::set() throw (Switchable::SwitchingError) { fset = true; }
+void MultiSwitchable::set() GETOPTPP_THROW(Switchable::SwitchingError) { fset = true; }
 MultiSwitchable::~MultiSwitchable() {}
 
 
-void UniquelySwitchable::set() throw (Switchable::SwitchingError) {
+void UniquelySwitchable::set() GETOPTPP_THROW(Switchable::SwitchingError) {
 	if(UniquelySwitchable::isSet()) throw Switchable::SwitchingError();
 	fset = true;
 }
 UniquelySwitchable::~UniquelySwitchable() {}
 
 
+PresettableUniquelySwitchable::PresettableUniquelySwitchable() : fpreset(false), fimplicit(false) {}
 PresettableUniquelySwitchable::~PresettableUniquelySwitchable() {}
 bool PresettableUniquelySwitchable::isSet() const {
-	return UniquelySwitchable::isSet() || fpreset.isSet();
+	return UniquelySwitchable::isSet() || fpreset;
 }
-void PresettableUniquelySwitchable::set() throw (Switchable::SwitchingError)
+void PresettableUniquelySwitchable::set() GETOPTPP_THROW(Switchable::SwitchingError)
 {
 	UniquelySwitchable::set();
 }
 void PresettableUniquelySwitchable::preset() {
-	fpreset.set();
+	fpreset = true;
+	fimplicit = false;
+}
+void PresettableUniquelySwitchable::presetImplicitly() {
+	fpreset = true;
+	fimplicit = true;
+}
+bool PresettableUniquelySwitchable::presetByProgram() const {
+	return fpreset && !fimplicit;
+}
+unsigned PresettableUniquelySwitchable::state() const {
+	return UniquelySwitchable::state() | (fpreset ? Parameter::STATE_PRESET : 0);
+}
+void PresettableUniquelySwitchable::restoreState(unsigned state) {
+	UniquelySwitchable::restoreState(state);
+	fpreset = (state & Parameter::STATE_PRESET) != 0;
 }
 
 /*
@@ -245,79 +1698,272 @@ SwitchParameter::SwitchParameter(char shortOption, const char *longOption,
 			const char* description) : CommonParameter<MultiSwitchable>(shortOption, longOption, description) {}
 SwitchParameter::~SwitchParameter() {}
 
-void SwitchParameter::receiveSwitch() throw(Parameter::ParameterRejected) {
+bool SwitchParameter::takesArgument() const { return false; }
+const char* SwitchParameter::typeName() const { return "switch"; }
+
+void SwitchParameter::receiveSwitch() GETOPTPP_THROW(Parameter::ParameterRejected) {
 	set();
 }
 
-void SwitchParameter::receiveArgument(const string &arg) throw(Parameter::ParameterRejected) {
+void SwitchParameter::receiveArgument(const string &) GETOPTPP_THROW(Parameter::ParameterRejected) {
 	throw UnexpectedArgument();
 }
 
 /*
  *
- * PODParameter specializations
- *
+ * Class EnumMatcher
  *
  *
  */
 
+EnumMatcher::EnumMatcher() : fminLength(1), fmaxLength(0), fignoreCase(false) {}
 
-template<>
-PODParameter<string>::PODParameter(char shortOption, const char *longOption,
-		const char* description) : CommonParameter<PresettableUniquelySwitchable>(shortOption, longOption, description) {
-	preset();
+bool EnumMatcher::ignoresCase() const { return fignoreCase; }
+
+size_t EnumMatcher::memoryUsage() const {
+	return fslots.capacity() * sizeof(Slot) + fdisplacements.capacity() * sizeof(uint32_t);
 }
 
+static inline char foldCase(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
 
-template<>
-int PODParameter<int>::validate(const string &s) throw(Parameter::ParameterRejected)
+/* 64-bit FNV-1a, optionally over case-folded characters */
+uint64_t EnumMatcher::hash(const char* s, size_t length) const {
+	uint64_t h = 14695981039346656037ULL;
+	if(fignoreCase) {
+		for(size_t i = 0; i < length; i++) h = (h ^ (unsigned char) foldCase(s[i])) * 1099511628211ULL;
+	} else {
+		for(size_t i = 0; i < length; i++) h = (h ^ (unsigned char) s[i]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+bool EnumMatcher::equal(const char* a, const char* b, size_t length) const {
+	if(!fignoreCase) return memcmp(a, b, length) == 0;
+	for(size_t i = 0; i < length; i++) {
+		if(foldCase(a[i]) != foldCase(b[i])) return false;
+	}
+	return true;
+}
+
+/* Scatters a hash with a bucket's displacement (the splitmix64 finalizer) */
+static inline uint64_t displace(uint64_t h, uint32_t d) {
+	h ^= d * 0x9E3779B97F4A7C15ULL;
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	return h ^ (h >> 31);
+}
+
+void EnumMatcher::build(const vector<const char*>& names, bool ignoreCase) {
+	fignoreCase = ignoreCase;
+	fminLength = 1;
+	fmaxLength = 0;
+
+	size_t slots = 2;
+	while(slots < 2*names.size()) slots *= 2;
+	size_t buckets = names.size() / 4 + 1;
+
+	Slot empty = { NULL, 0, -1 };
+	fslots.assign(slots, empty);
+	fdisplacements.assign(buckets, 0);
+
+	vector<uint64_t> hashes(names.size());
+	vector<vector<size_t> > members(buckets);
+	for(size_t i = 0; i < names.size(); i++) {
+		size_t length = strlen(names[i]);
+		if(i == 0 || length < fminLength) fminLength = length;
+		if(length > fmaxLength) fmaxLength = length;
+
+		hashes[i] = hash(names[i], length);
+		members[hashes[i] % buckets].push_back(i);
+	}
+
+	/* Place the largest buckets first, while the table is still mostly empty */
+	vector<pair<size_t, size_t> > order;
+	for(size_t b = 0; b < buckets; b++) {
+		if(!members[b].empty()) order.push_back(make_pair(members[b].size(), b));
+	}
+	sort(order.rbegin(), order.rend());
+
+	vector<size_t> placed;
+	for(size_t o = 0; o < order.size(); o++) {
+		const vector<size_t>& bucket = members[order[o].second];
+
+		for(uint32_t d = 0; ; d++) {
+			if(d == (1U << 24)) {
+				throw logic_error(string("EnumMatcher: duplicate name ") + names[bucket[0]]);
+			}
+
+			placed.clear();
+			for(size_t i = 0; i < bucket.size(); i++) {
+				size_t slot = displace(hashes[bucket[i]], d) & (slots - 1);
+				if(fslots[slot].name) break;
+
+				fslots[slot].name = names[bucket[i]];
+				placed.push_back(slot);
+			}
+
+			if(placed.size() == bucket.size()) {
+				for(size_t i = 0; i < bucket.size(); i++) {
+					fslots[placed[i]].length = strlen(names[bucket[i]]);
+					fslots[placed[i]].index = bucket[i];
+				}
+				fdisplacements[order[o].second] = d;
+				break;
+			}
+
+			for(size_t i = 0; i < placed.size(); i++) fslots[placed[i]].name = NULL;
+
+			/* Equal names always collide, so catch them before searching in vain */
+			if(d == 0) {
+				for(size_t i = 0; i < bucket.size(); i++) for(size_t j = i+1; j < bucket.size(); j++) {
+					size_t length = strlen(names[bucket[i]]);
+					if(hashes[bucket[i]] == hashes[bucket[j]] && length == strlen(names[bucket[j]])
+							&& equal(names[bucket[i]], names[bucket[j]], length))
+						throw logic_error(string("EnumMatcher: duplicate name ") + names[bucket[i]]);
+				}
+			}
+		}
+	}
+}
+
+long EnumMatcher::find(const char* s, size_t length) const {
+	if(length < fminLength || length > fmaxLength) return -1;
+
+	uint64_t h = hash(s, length);
+	const Slot& slot = fslots[displace(h, fdisplacements[h % fdisplacements.size()]) & (fslots.size() - 1)];
+
+	if(slot.name && slot.length == length && equal(slot.name, s, length)) return slot.index;
+	return -1;
+}
+
+/*
+ *
+ * Struct ValueParser specializations
+ *
+ *
+ */
+
+bool ValueParser<int>::parse(const string &s, int& value, string& error)
 {
 	// This is sadly necessary for strto*-functions to operate on
 	// const char*. The function doesn't write to the memory, though,
 	// so it's quite safe.
 
 	char* cstr = const_cast<char*>(s.c_str());
-	if(*cstr == '\0') throw ParameterRejected("No argument given");
+	if(*cstr == '\0') {
+		error = "No argument given";
+		return false;
+	}
 
 	long l = strtol(cstr, &cstr, 10);
-	if(*cstr != '\0') throw ParameterRejected("Expected int");
-
-	if(l > INT_MAX || l < INT_MIN) {
-		throw ParameterRejected("Expected int");
+	if(*cstr != '\0' || l > INT_MAX || l < INT_MIN) {
+		error = "Expected int";
+		return false;
 	}
 
-	return l;
+	value = l;
+	return true;
 }
 
-template<>
-long PODParameter<long>::validate(const string &s) throw(Parameter::ParameterRejected)
+bool ValueParser<long>::parse(const string &s, long& value, string& error)
 {
 	char* cstr = const_cast<char*>(s.c_str());
-	if(*cstr == '\0') throw ParameterRejected("No argument given");
+	if(*cstr == '\0') {
+		error = "No argument given";
+		return false;
+	}
 
 	long l = strtol(cstr, &cstr, 10);
-	if(*cstr != '\0') throw ParameterRejected("Expected long");
+	if(*cstr != '\0') {
+		error = "Expected long";
+		return false;
+	}
 
-	return l;
+	value = l;
+	return true;
 }
 
-template<>
-double PODParameter<double>::validate(const string &s) throw(Parameter::ParameterRejected)
+bool ValueParser<double>::parse(const string &s, double& value, string& error)
 {
 	char* cstr = const_cast<char*>(s.c_str());
-	if(*cstr == '\0') throw ParameterRejected("No argument given");
+	if(*cstr == '\0') {
+		error = "No argument given";
+		return false;
+	}
 
 	double d = strtod(cstr, &cstr);
-	if(*cstr != '\0') throw ParameterRejected("Expected double");
+	if(*cstr != '\0') {
+		error = "Expected double";
+		return false;
+	}
 
-	return d;
+	value = d;
+	return true;
 }
 
+
+/*
+ *
+ * PODParameter specializations
+ *
+ *
+ *
+ */
+
+
 template<>
-string PODParameter<string>::validate(const string &s) throw(Parameter::ParameterRejected)
-{
-	return s;
+PODParameter<string>::PODParameter(char shortOption, const char *longOption,
+		const char* description) : CommonParameter<PresettableUniquelySwitchable>(shortOption, longOption, description) {
+	presetImplicitly();
+}
+
+
+/* The text forms parse back to the same value */
+
+template<>
+bool PODParameter<int>::formatArgument(string& out) const {
+	if(!isSet()) return false;
+
+	char buf[16];
+	out.append(buf, snprintf(buf, sizeof(buf), "%d", value));
+	return true;
+}
+
+template<>
+bool PODParameter<long>::formatArgument(string& out) const {
+	if(!isSet()) return false;
+
+	char buf[32];
+	out.append(buf, snprintf(buf, sizeof(buf), "%ld", value));
+	return true;
+}
+
+template<>
+bool PODParameter<double>::formatArgument(string& out) const {
+	if(!isSet()) return false;
+
+	/* Use the short form when it is exact, %.17g is enough digits for any double */
+	char buf[32];
+	int n = snprintf(buf, sizeof(buf), "%.15g", value);
+	if(strtod(buf, NULL) != value) n = snprintf(buf, sizeof(buf), "%.17g", value);
+
+	out.append(buf, n);
+	return true;
+}
+
+template<>
+bool PODParameter<string>::formatArgument(string& out) const {
+	if(!isSet()) return false;
+
+	out.append(value);
+	return true;
 }
 
+template<> const char* PODParameter<int>::typeName() const { return "int"; }
+template<> const char* PODParameter<long>::typeName() const { return "long"; }
+template<> const char* PODParameter<double>::typeName() const { return "double"; }
+template<> const char* PODParameter<string>::typeName() const { return "string"; }
 
 } //namespace
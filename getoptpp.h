@@ -20,13 +20,34 @@
 #include <stdexcept>
 #include <string>
 #include <climits>
+#include <cstring>
+#include <typeinfo>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
-#include <sstream>
-#include <iostream>
+#include <cstdio>
+#include <exception>
 
 #ifndef GETOPTPP_H
 #define GETOPTPP_H
 
+/* The library's interface, which stays visible when the shared library is
+ * built with -fvisibility=hidden */
+#if defined(__GNUC__)
+#define GETOPTPP_API __attribute__((visibility("default")))
+#else
+#define GETOPTPP_API
+#endif
+
+/* Dynamic exception specifications, which document what the functions of
+ * the library throw, but are no longer allowed as of C++17 */
+#if __cplusplus < 201703L
+#define GETOPTPP_THROW(...) throw(__VA_ARGS__)
+#else
+#define GETOPTPP_THROW(...)
+#endif
+
 namespace vlofgren {
 
 class Parameter;
@@ -35,10 +56,30 @@ class ParserState;
 using namespace std;
 
 class OptionsParser;
+class ParseErrors;
+struct MemoryUsage;
+class OutputSink;
+struct OptionDescriptor;
+
+/** A group of parameters, used to state constraints in a ParameterSet
+ *
+ *	ps.exclusive(ParameterGroup(verbose).add(quiet));
+ */
+class GETOPTPP_API ParameterGroup {
+public:
+	ParameterGroup();
+	ParameterGroup(Parameter& p);
+
+	ParameterGroup& add(Parameter& p);
+
+	const vector<Parameter*>& members() const;
+private:
+	vector<Parameter*> fmembers;
+};
 
 /** Container for a set of parameters */
 
-class ParameterSet {
+class GETOPTPP_API ParameterSet {
 public:
 
 	/** Find a parameter by short option form */
@@ -63,16 +104,381 @@ public:
 	template<typename T>
 	T &add(char shortName, const char* longName, const char* description);
 
+	/** Number of parameters in the set */
+	size_t size() const;
+
+	/** The parameters in the order they were added */
+	const vector<Parameter*>& ordered() const;
+
+	/** Require at least one parameter of the group to be given.
+	 *
+	 * (A single parameter is more simply required with Parameter::setRequired().)
+	 */
+	void requireAny(const ParameterGroup& group);
+
+	/** Allow at most one parameter of the group to be given */
+	void exclusive(const ParameterGroup& group);
+
+	/** If any parameter of dependent is given, require every parameter of dependency
+	 * to be given as well.
+	 */
+	void depends(const ParameterGroup& dependent, const ParameterGroup& dependency);
+
+	/** Add the bytes used by the set and its parameters to usage */
+	void memoryUsage(MemoryUsage& usage) const;
+
+	/** Formats of exportConfig() */
+	enum ExportFormat {
+		EXPORT_JSON,
+		EXPORT_BINARY
+	};
+
+	/** Write the name, type, value, source and set status of every parameter
+	 * to out, in order of addition.
+	 *
+	 * As JSON, this is an array of objects such as
+	 *
+	 *	{"name":"size","short":"s","type":"size","value":"4G","source":"preset","set":true}
+	 *
+	 * The value is the text formatArgument() gives, or null if there is none (as
+	 * for switches). The source is "command-line", "preset" for a value from
+	 * PODParameter::setDefault() (see Parameter::hasDefault()), or "default"
+	 * for neither. The short option is null if there is none.
+	 *
+	 * The binary form is the magic "GOX1" and the uint32 number of parameters,
+	 * followed by a record for each: its source (uint8, 0 for default, 1 for
+	 * preset, 2 for command-line), set status (uint8), short option (char, 0
+	 * for none), and then its type, name and value, each as a uint32 length and
+	 * that many bytes. A missing value has the length 0xffffffff. Integers are
+	 * in host byte order, as in OptionsParser::snapshot().
+	 *
+	 * Nothing is allocated for each field, and written to a BufferSink, the
+	 * export goes straight into the caller's buffer.
+	 */
+	void exportConfig(OutputSink& out, ExportFormat format = EXPORT_JSON) const;
+
+	/** Check the constraints, and the required parameters, against the
+	 * parameters given in a parse.
+	 *
+	 * Constraints are about parameters given on the command line; a default
+	 * value does not satisfy a requirement.
+	 *
+	 * @param given Bitset of the given parameters, by Parameter::index()
+	 * @param required Bitset of the required parameters
+	 * @param errors Where to add violations, or NULL to throw the first one.
+	 * @throw Parameter::ConstraintViolation
+	 */
+	void checkConstraints(const vector<uint64_t>& given, const vector<uint64_t>& required,
+			ParseErrors* errors) const GETOPTPP_THROW(runtime_error);
+
 	ParameterSet() {}
 	~ParameterSet();
 protected:
 	friend class OptionsParser;
 	set<Parameter*> parameters;
+	vector<Parameter*> fordered;
+
+	/** The words of a bitset over the parameters that have any bit set */
+	typedef vector<pair<size_t, uint64_t> > Mask;
+
+	/** A constraint, compiled to masks so that checking it takes a few word operations */
+	struct Constraint {
+		enum Kind { ANY, AT_MOST_ONE, DEPENDS } kind;
+		Mask first, second;
+	};
+
+	vector<Constraint> fconstraints;
+
+	Mask compile(const ParameterGroup& group) const;
+
+	/** Collect the parameters of mask that are set (or not set) in bits, and their names */
+	void select(const Mask& mask, const vector<uint64_t>& bits, bool set,
+			vector<const Parameter*>& selected, string& names) const;
+
+	/** Add a violation to errors, or throw it if errors is NULL */
+	void violation(int kind, const string& message, const vector<const Parameter*>& involved,
+			ParseErrors* errors) const;
 
 private:
 	ParameterSet(const ParameterSet& ps);
 };
 
+/** A single problem found while parsing, see ParseErrors */
+struct ParseError {
+	enum Kind {
+		UNKNOWN_OPTION,		/**< Looks like an option, but matches no parameter */
+		DUPLICATE_OPTION,	/**< Parameter given more than once */
+		MISSING_ARGUMENT,	/**< Parameter expected an argument */
+		UNEXPECTED_ARGUMENT,	/**< Parameter did not expect an argument */
+		BAD_VALUE,		/**< Parameter rejected its argument */
+		MISSING_REQUIRED,	/**< Required parameter (or one of a required group) not given */
+		CONFLICTING_OPTIONS,	/**< More than one parameter of an exclusive group given */
+		MISSING_DEPENDENCY	/**< Parameter given without a parameter it depends on */
+	};
+
+	Kind kind;
+
+	/** Index in argv of the offending element, or -1 if the error isn't tied to one */
+	int position;
+
+	/** The parameter concerned, if known */
+	const Parameter* parameter;
+
+	string message;
+};
+
+/** Collects every error of a parse, see OptionsParser::parse(int, const char*[], ParseErrors&)
+ *
+ * The list is allocated up front with a fixed capacity, and reused from parse to parse.
+ * Once it is full the parse stops, which bounds the cost of parsing garbage.
+ */
+class GETOPTPP_API ParseErrors {
+public:
+	ParseErrors(size_t capacity = 32);
+
+	/** Forget all errors (but keep the storage) */
+	void clear();
+
+	size_t size() const;
+	bool empty() const;
+
+	/** Test whether the list filled up, so that the input may contain more errors */
+	bool full() const;
+
+	const ParseError& operator[](size_t i) const;
+
+	void add(ParseError::Kind kind, int position, const Parameter* parameter, const string& message);
+private:
+	friend class DeferredValidation;
+
+	/** Add errors found out of order, keeping the list in argv order */
+	void merge(const vector<ParseError>& errors);
+
+	vector<ParseError> ferrors;
+	size_t fcount;
+};
+
+/** Bytes used by a parser, by component, see OptionsParser::memoryUsage()
+ *
+ * Heap blocks are counted by their requested size, without the allocator's
+ * own overhead.
+ */
+struct GETOPTPP_API MemoryUsage {
+	size_t parser;		/**< The parser itself, with its short option table and bitsets */
+	size_t parameters;	/**< The parameter objects */
+	size_t names;		/**< Long option names, in the pool shared with other parsers */
+	size_t descriptions;	/**< Descriptions, in the pool shared with other parsers */
+	size_t values;		/**< Values held outside the objects, e.g. long strings */
+	size_t index;		/**< The containers of the parameter set */
+	size_t constraints;	/**< The compiled constraints */
+	size_t files;		/**< The non-parameter arguments of the last parse */
+
+	MemoryUsage();
+
+	size_t total() const;
+
+	/** Bytes a string holds on the heap */
+	static size_t heap(const string& s);
+};
+
+/** Where the parser allocates the result of a parse, see OptionsParser::setMemoryResource()
+ *
+ * The same interface as std::pmr::memory_resource, so that it can be used
+ * before C++17 too. PmrResource (pmr.h) adapts a std::pmr::memory_resource to it.
+ */
+class GETOPTPP_API MemoryResource {
+public:
+	virtual void* allocate(size_t bytes, size_t alignment) = 0;
+	virtual void deallocate(void* p, size_t bytes, size_t alignment) = 0;
+	virtual ~MemoryResource() {}
+
+	/** The resource using the global operator new and delete */
+	static MemoryResource* newDelete();
+};
+
+/** Hands out memory from a buffer, and then from blocks allocated from its
+ * upstream resource, without freeing anything until release().
+ *
+ *	char buffer[4096];
+ *	MonotonicResource arena(buffer, sizeof(buffer));
+ *	parser.setMemoryResource(&arena);
+ *	...
+ *	parser.reset();
+ *	arena.release();
+ */
+class GETOPTPP_API MonotonicResource : public MemoryResource {
+public:
+	MonotonicResource(MemoryResource* upstream = MemoryResource::newDelete());
+	MonotonicResource(void* buffer, size_t size, MemoryResource* upstream = MemoryResource::newDelete());
+	virtual ~MonotonicResource();
+
+	virtual void* allocate(size_t bytes, size_t alignment);
+
+	/** Does nothing, the memory is only freed by release() */
+	virtual void deallocate(void* p, size_t bytes, size_t alignment);
+
+	/** Free everything, and go back to the start of the buffer */
+	void release();
+
+	/** Bytes handed out since the last release() */
+	size_t used() const;
+private:
+	MonotonicResource(const MonotonicResource&);
+	MonotonicResource& operator=(const MonotonicResource&);
+
+	struct Block {
+		Block* next;
+		size_t size;
+	};
+
+	MemoryResource* fupstream;
+	char* fbuffer;
+	size_t fbufferSize;
+	char* fnext;
+	size_t fleft;
+	Block* fblocks;
+	size_t fblockSize;
+	size_t fused;
+};
+
+/** Standard allocator over a MemoryResource, for the parser's containers */
+template<typename T>
+class ResourceAllocator {
+public:
+	typedef T value_type;
+	typedef true_type propagate_on_container_copy_assignment;
+	typedef true_type propagate_on_container_move_assignment;
+	typedef true_type propagate_on_container_swap;
+
+	ResourceAllocator(MemoryResource* resource = MemoryResource::newDelete()) : fresource(resource) {}
+	template<typename U>
+	ResourceAllocator(const ResourceAllocator<U>& other) : fresource(other.resource()) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(fresource->allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T* p, size_t n) { fresource->deallocate(p, n * sizeof(T), alignof(T)); }
+
+	MemoryResource* resource() const { return fresource; }
+
+	template<typename U>
+	bool operator==(const ResourceAllocator<U>& other) const { return fresource == other.resource(); }
+	template<typename U>
+	bool operator!=(const ResourceAllocator<U>& other) const { return fresource != other.resource(); }
+private:
+	MemoryResource* fresource;
+};
+
+/** Where OptionsParser::usage() writes its text.
+ *
+ * The parser itself doesn't use iostreams; they are only pulled in by
+ * streams.h, which getoptpp.h includes unless GETOPTPP_NO_IOSTREAM is defined.
+ */
+class GETOPTPP_API OutputSink {
+public:
+	virtual void write(const char* data, size_t length) = 0;
+	virtual ~OutputSink() {}
+};
+
+/** Writes to a stdio stream */
+class GETOPTPP_API FileSink : public OutputSink {
+public:
+	FileSink(FILE* file);
+
+	virtual void write(const char* data, size_t length);
+private:
+	FILE* ffile;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+/** Writes straight to a file descriptor, without any buffering */
+class GETOPTPP_API FdSink : public OutputSink {
+public:
+	FdSink(int fd);
+
+	virtual void write(const char* data, size_t length);
+private:
+	int ffd;
+};
+#endif
+
+/** Writes into a fixed buffer, which is kept nul terminated, and drops what doesn't fit */
+class GETOPTPP_API BufferSink : public OutputSink {
+public:
+	BufferSink(char* buffer, size_t capacity);
+
+	virtual void write(const char* data, size_t length);
+
+	/** Number of characters in the buffer (not counting the nul) */
+	size_t length() const;
+
+	/** Test whether anything was dropped */
+	bool truncated() const;
+private:
+	char* fbuffer;
+	size_t fcapacity;
+	size_t flength;
+	bool ftruncated;
+};
+
+/** Passes the text to a function */
+class GETOPTPP_API CallbackSink : public OutputSink {
+public:
+	typedef void (*Callback)(const char* data, size_t length, void* context);
+
+	CallbackSink(Callback callback, void* context = NULL);
+
+	virtual void write(const char* data, size_t length);
+private:
+	Callback fcallback;
+	void* fcontext;
+};
+
+/** Perfect-hash matcher for a fixed set of names.
+ *
+ * The names are spread over a table twice their number with hash-and-displace:
+ * names are grouped into small buckets, and each bucket is given the first
+ * displacement that sends all of its names to free slots. A lookup is thus one
+ * hash of the argument, two table reads and a single string comparison, regardless
+ * of how many names there are.
+ *
+ * Matching is locale-free, and optionally ignores ASCII case.
+ */
+class GETOPTPP_API EnumMatcher {
+public:
+	EnumMatcher();
+
+	/** (Re)build the matcher.
+	 *
+	 * @param names Names to match. The pointers must stay valid as long as the matcher is used.
+	 * @throw logic_error if two names are equal (after case folding, if ignoreCase).
+	 */
+	void build(const vector<const char*>& names, bool ignoreCase);
+
+	/** Look up a name.
+	 *
+	 * @return The index of the name in the vector given to build(), or -1 if none matched.
+	 */
+	long find(const char* s, size_t length) const;
+
+	bool ignoresCase() const;
+
+	/** Bytes of the tables, see MemoryUsage */
+	size_t memoryUsage() const;
+private:
+	uint64_t hash(const char* s, size_t length) const;
+	bool equal(const char* a, const char* b, size_t length) const;
+
+	struct Slot {
+		const char *name;
+		size_t length;
+		long index;
+	};
+
+	vector<Slot> fslots;
+	vector<uint32_t> fdisplacements;
+	size_t fminLength, fmaxLength;
+	bool fignoreCase;
+};
+
 /** getopt()-style parser for command line arguments
  *
  * Matches each element in argv against given
@@ -81,19 +487,160 @@ private:
  *
  */
 
-class OptionsParser {
+class GETOPTPP_API OptionsParser {
 public:
 	OptionsParser(const char *programDesc);
 	virtual ~OptionsParser();
 
 	ParameterSet& getParameters();
+	const ParameterSet& getParameters() const;
 
-	/** Parse command line arguments */
-	void parse(int argc, const char* argv[]) throw(runtime_error);
+	/** Add the options registered anywhere in the program with
+	 * GETOPTPP_OPTION() and GETOPTPP_SWITCH() (see registry.h).
+	 *
+	 * Options are only discovered when this is called, so a program that never
+	 * calls it pays nothing for them. Calling it more than once has no effect.
+	 *
+	 * The options write to global variables, so only one parser at a time
+	 * may have them: they are given up when it is destroyed.
+	 *
+	 * @throw logic_error if another parser has the registered options
+	 *
+	 * Only the options of the executable or shared object this is called
+	 * from are found, since each has its own registered options (this is
+	 * inline, so that it finds the caller's rather than libgetoptpp.so's).
+	 */
+	void addRegisteredOptions();
 
-	/** Generate a usage screen */
+	/** Add the registered options [begin, end), see addRegisteredOptions() */
+	void addRegisteredOptions(const OptionDescriptor* begin, const OptionDescriptor* end);
+
+	/** Validate the arguments of expensive parameters (see Parameter::setExpensive())
+	 * on up to threads threads.
+	 *
+	 * Their validation is then deferred until the whole command line has been
+	 * scanned, and run in parallel. The outcome is the same as that of a serial
+	 * parse: parse() throws the error that comes first in argv, and errors are
+	 * collected in argv order. An IncrementalParser always validates serially.
+	 *
+	 * @param threads 0 (the default) to validate every argument as it is parsed
+	 */
+	void setValidationThreads(unsigned threads);
+
+	/** Allocate the files of each parse from resource instead of the global heap.
+	 *
+	 * With a MonotonicResource per request, the files of a parse are released
+	 * together with the resource. Call reset() before releasing it, since the
+	 * parser points into it until then: a parse after the resource has been
+	 * released without a reset() reads freed memory. The resource must also
+	 * outlive the parser, or be replaced before it goes. Each parse starts by
+	 * forgetting the files of the last one, as does changing the resource.
+	 *
+	 * Read the files with fileCount() and file(), which don't allocate;
+	 * getFiles() then copies them to the global heap the first time it's
+	 * called after a parse.
+	 *
+	 * Only the files come from the resource. A string value too long to be
+	 * held inside the string itself is still allocated on the heap, once for
+	 * each option that sets one, and so is the message of each error.
+	 *
+	 * @param resource The resource, or NULL for the global heap (the default)
+	 */
+	void setMemoryResource(MemoryResource* resource);
+
+	/** The resource set with setMemoryResource(), or NULL */
+	MemoryResource* memoryResource() const;
+
+	/** Expand the wildcards in files, e.g. *.parquet, as the shell would
+	 * (see GlobExpander in glob.h for the syntax).
+	 *
+	 * The matches of a pattern take its place among the files, sorted. A path
+	 * matched by more than one pattern is only listed the first time, and a
+	 * pattern that matches nothing is kept as it is. An IncrementalParser
+	 * reports each match as a positional event of its own.
+	 *
+	 * @param threads Threads to walk directories with, 0 for one per core
+	 */
+	void setGlobExpansion(bool expand, unsigned threads = 0);
+
+	/** Parse command line arguments
+	 *
+	 * Short options may be clustered POSIX-style, e.g. -xvf is equivalent to
+	 * -x -v -f. Every switch in a cluster is set, and the first option that
+	 * takes an argument consumes the rest of the cluster (-xvfarchive) or, if
+	 * nothing remains, the next element of argv (-xvf archive).
+	 *
+	 * Each parse starts from a reset() parser, so a parser can parse one
+	 * command line after another.
+	 */
+	void parse(int argc, const char* argv[]) GETOPTPP_THROW(runtime_error);
+
+	/** Parse command line arguments, collecting every error instead of stopping at the first.
+	 *
+	 * Parsing goes on past unknown options and rejected arguments, and required
+	 * parameters are checked at the end. The errors are listed in argv order.
+	 * The built-in types report a rejected argument without throwing, see
+	 * PODParameter::tryValidate().
+	 *
+	 * @param errors Cleared, and then filled with the errors found.
+	 * @return true if there were no errors
+	 */
+	bool parse(int argc, const char* argv[], ParseErrors& errors);
+
+	/** Forget the result of a parse, so that the parser can be used again.
+	 *
+	 * Clears the files and everything set from the command line, while
+	 * defaults (see PODParameter::setDefault()) are kept.
+	 */
+	void reset();
+
+	/** Test whether a parameter was given on the command line in the last parse */
+	bool wasGiven(const Parameter& p) const;
+
+	/** Exception thrown by restore() if a snapshot is damaged, or was not taken
+	 * with the same parameters */
+	class InvalidSnapshot : public runtime_error {
+	public:
+		InvalidSnapshot(const string& s) : runtime_error(s) {}
+	};
+
+	/** Append a snapshot of the parsed state to out.
+	 *
+	 * The snapshot is a flat, position-independent binary record of each
+	 * parameter's set/preset state and value, the files and the program name.
+	 * Another parser with the same parameters (typically the same program, in
+	 * a forked or spawned worker) can restore() it without parsing or validating
+	 * anything. Integers and values are in host byte order: a snapshot passes
+	 * between processes of one build on one architecture, and is not a file
+	 * format to keep.
+	 *
+	 * @throw logic_error if a parameter's value type can't be saved (see ValueCodec)
+	 */
+	void snapshot(string& out) const;
+
+	/** Restore the state saved by snapshot().
+	 *
+	 * The snapshot may come straight from a pipe or an mmap()ed file; it is
+	 * read with no alignment requirements. It is checked as a whole before
+	 * anything is changed.
+	 *
+	 * @throw InvalidSnapshot if the snapshot is damaged, or its schema differs from this parser's
+	 */
+	void restore(const char* data, size_t length);
+
+	/** Hash of the parameters' names, types and order, which restore() checks
+	 * snapshots against. */
+	uint64_t schemaHash() const;
+
+	/** Bytes used by the parser, its parameters and the result of the last parse */
+	MemoryUsage memoryUsage() const;
+
+	/** Generate a usage screen on stderr */
 	void usage() const;
 
+	/** Generate a usage screen */
+	void usage(OutputSink& out) const;
+
 	/** Return the name of the program, as
 	 * given by argv[0]
 	 */
@@ -101,14 +648,220 @@ public:
 
 	/** Return a vector of each non-parameter */
 	const vector<string>& getFiles() const;
+
+	/** Number of non-parameters */
+	size_t fileCount() const;
+
+	/** The i:th non-parameter, which is nul terminated */
+	const char* file(size_t i, size_t& length) const;
 protected:
 	string argv0;
 	string fprogramDesc;
 
 	ParameterSet parameters;
-	vector<string> files;
+
+	/** The files, or with a memory resource, a copy of them made by getFiles() */
+	mutable vector<string> files;
 
 	friend class ParserState;
+private:
+	/** Build the short option table and the required bitset from the current parameter set */
+	void buildIndex();
+
+	/** Decode a cluster of short options (e.g. -xvf) through the short option table.
+	 *
+	 * @param errors Where to record unknown options, or NULL to throw
+	 * @return false if the first option isn't in the table, in which case
+	 * 			the token should be offered to the parameters of fpolled
+	 */
+	bool receiveShortCluster(ParserState& state, ParseErrors* errors) GETOPTPP_THROW(runtime_error);
+
+	/** Decode --option or --option=argument through the long option index.
+	 *
+	 * The token is scanned once, up to the first '=', and the argument is
+	 * copied once, however many parameters there are.
+	 *
+	 * @return false if the option isn't in the index, in which case the
+	 * 			token should be offered to the parameters of fpolled
+	 */
+	bool receiveLongOption(ParserState& state) GETOPTPP_THROW(runtime_error);
+
+	/** Parse argv, throwing on the first error if errors is NULL */
+	void parseArguments(int argc, const char* argv[], ParseErrors* errors);
+
+	/** Prepare for the arguments of a new command line */
+	void beginArguments(const string& programName);
+
+	/** receiveArgument(), recording the errors it throws in errors unless that is NULL
+	 *
+	 * @return false if the argument is "--", which ends the options
+	 */
+	bool dispatchArgument(ParserState& state, ParseErrors* errors) GETOPTPP_THROW(runtime_error);
+
+	/** Match the current argument against the parameters, and collect it
+	 * as a file if it isn't an option.
+	 *
+	 * @return false if the argument is "--", which ends the options
+	 */
+	bool receiveArgument(ParserState& state, ParseErrors* errors) GETOPTPP_THROW(runtime_error);
+
+	void markGiven(const Parameter& p);
+	void unmarkGiven(const Parameter& p);
+
+	/** Add a file to the result of the parse */
+	void addFile(const char* name, size_t length);
+
+	/** addFile(), or of each of its matches if it's a pattern to expand */
+	void receiveFile(const char* name, size_t length);
+
+	void clearFiles();
+
+	friend class SnapshotView;
+	friend class IncrementalParser;
+
+	/** Flat short option -> parameter table, indexed by unsigned char. Holds
+	 * the parameter's index() + 1, or 0 for none, which takes a quarter of the
+	 * space of pointers (see shortIndex()). */
+	uint16_t fshortIndex[256];
+
+	/** The parameter for a short option, or NULL */
+	Parameter* shortIndex(char c) const;
+
+	/** Long option -> position in flongParameters */
+	EnumMatcher flongIndex;
+
+	/** The parameters of flongIndex, by Parameter::index() */
+	vector<uint32_t> flongParameters;
+
+	/** Number of parameters when flongIndex was built. Parameters can only be
+	 * added, so it is rebuilt when this changes. */
+	size_t flongIndexed;
+
+	/** The parameters the indexes can't decode (custom receive(), no long
+	 * option, or no room in fshortIndex), whose receive() is asked for every
+	 * token the indexes don't take, in set order. Rebuilt with flongIndex. */
+	vector<uint32_t> fpolled;
+
+	/** Bitset of the parameters given in the last parse, by Parameter::index() */
+	vector<uint64_t> fgiven;
+
+	/** Bitset of the required parameters */
+	vector<uint64_t> frequired;
+
+	/** The parameter handling the current argument, for ParseError::parameter */
+	const Parameter* fcurrent;
+
+	/** Whether addRegisteredOptions() has been called */
+	bool fregistered;
+
+	/** Give up the registered options for another parser to take */
+	void releaseRegisteredOptions();
+
+	unsigned fvalidationThreads;
+
+	/** Where markGiven() also lists the parameters, while an IncrementalParser drives the parse */
+	vector<const Parameter*>* fmatched;
+
+	/** A file allocated from fresource */
+	struct FileEntry {
+		char* name;
+		size_t length;
+	};
+
+	MemoryResource* fresource;
+
+	/** The files, while fresource is set */
+	vector<FileEntry, ResourceAllocator<FileEntry> > ffileEntries;
+
+	/** Whether files is out of date with ffileEntries */
+	mutable bool ffilesStale;
+
+	/** The copy of argv made by parse(), kept to reuse its strings */
+	vector<string> ftokens;
+
+	/** The argument of an option given in the same element of argv, e.g.
+	 * --option=argument, copied out of it. Assigning over it reuses its buffer. */
+	string fargument;
+
+	bool fglob;
+	unsigned fglobThreads;
+
+	/** The matches of the patterns expanded so far in this parse, made by the first */
+	struct GlobSeen;
+	GlobSeen* fglobSeen;
+};
+
+#if defined(__ELF__)
+
+/* The linker defines these for every section whose name is a valid C
+ * identifier. They are weak so that a program without any registered
+ * option, and hence without the section, still links, and hidden so that
+ * they are resolved in the executable or shared object that refers to
+ * them, which is why the functions below are inline. */
+extern "C" {
+	extern const OptionDescriptor __start_getoptpp_options __attribute__((weak, visibility("hidden")));
+	extern const OptionDescriptor __stop_getoptpp_options __attribute__((weak, visibility("hidden")));
+}
+
+/** The options registered in the calling executable or shared object, as an array [begin, end) */
+inline const OptionDescriptor* registeredOptionsBegin() {
+	return &__start_getoptpp_options;
+}
+
+inline const OptionDescriptor* registeredOptionsEnd() {
+	return &__stop_getoptpp_options;
+}
+
+#else
+
+/** The options registered in the program, as an array [begin, end) */
+GETOPTPP_API const OptionDescriptor* registeredOptionsBegin();
+GETOPTPP_API const OptionDescriptor* registeredOptionsEnd();
+
+#endif
+
+inline void OptionsParser::addRegisteredOptions() {
+	addRegisteredOptions(registeredOptionsBegin(), registeredOptionsEnd());
+}
+
+/** Read-only view of a snapshot taken by OptionsParser::snapshot().
+ *
+ * The view points into the snapshot's bytes, which must outlive it.
+ * Parameters are referred to by Parameter::index().
+ */
+class GETOPTPP_API SnapshotView {
+public:
+	/** Check and index a snapshot.
+	 *
+	 * @param schema A parser with the parameters the snapshot was taken with.
+	 * @throw OptionsParser::InvalidSnapshot
+	 */
+	SnapshotView(const OptionsParser& schema, const char* data, size_t length);
+
+	/** Number of parameters */
+	size_t size() const;
+
+	/** The Parameter::STATE_* bits of a parameter */
+	unsigned switchState(size_t index) const;
+
+	/** The saved value of a parameter, as written by Parameter::saveValue(),
+	 * or NULL if it had none. */
+	const char* value(size_t index, size_t& length) const;
+
+	const char* programName(size_t& length) const;
+
+	size_t fileCount() const;
+	const char* file(size_t i, size_t& length) const;
+private:
+	struct Record {
+		unsigned state;
+		const char* value;
+		uint32_t length;
+	};
+
+	vector<Record> frecords;
+	vector<pair<const char*, uint32_t> > ffiles;
+	pair<const char*, uint32_t> fprogramName;
 };
 
 /**
@@ -116,20 +869,26 @@ protected:
  * for a const_iterator that handles nicer.
  */
 
-class ParserState {
+class GETOPTPP_API ParserState {
 public:
-	const string peek() const;
-	const string get() const;
+	const string& peek() const;
+	const string& get() const;
 	void advance();
 	bool end() const;
+
+	/** Index in argv of the current argument */
+	int position() const;
 protected:
-	ParserState(OptionsParser &opts, vector<string>& args);
+	/** @param offset Index in argv of args[0], less one (argv[0] is the program) */
+	ParserState(OptionsParser &opts, vector<string>& args, int offset = 0);
 private:
 	friend class OptionsParser;
+	friend class IncrementalParser;
 
 	OptionsParser &opts;
 	const vector<string> &arguments;
 	vector<string>::const_iterator iterator;
+	int foffset;
 };
 
 /**
@@ -138,7 +897,7 @@ private:
  *
  */
 
-class Parameter {
+class GETOPTPP_API Parameter {
 public:
 
 	/** Generic exception thrown when a parameter is malformed
@@ -147,6 +906,10 @@ public:
 	public:
 		ParameterRejected(const string& s) : runtime_error(s) {}
 		ParameterRejected() : runtime_error("") {}
+
+		/** Throw a copy of this exception, of the same type, with another
+		 * message. Subclasses that carry more than a message override it. */
+		virtual void rethrow(const string& s) const { throw ParameterRejected(s); }
 	};
 
 	/** Exception thrown when a parameter did not expect an argument */
@@ -163,6 +926,35 @@ public:
 		ExpectedArgument() {}
 	};
 
+	/** Exception thrown when a parameter can only be given once, and was repeated */
+	class AlreadySet : public ParameterRejected {
+	public:
+		AlreadySet(const string &s) : ParameterRejected(s) {}
+		AlreadySet() {}
+	};
+
+	/** Exception thrown when the parameters given violate a constraint of the ParameterSet */
+	class ConstraintViolation : public ParameterRejected {
+	public:
+		ConstraintViolation(const string &s, const vector<const Parameter*>& involved) :
+			ParameterRejected(s), finvolved(involved) {}
+		ConstraintViolation(const string &s) : ParameterRejected(s) {}
+		~ConstraintViolation() GETOPTPP_THROW() {}
+
+		/** The parameters the violation is about */
+		const vector<const Parameter*>& parameters() const { return finvolved; }
+	private:
+		vector<const Parameter*> finvolved;
+	};
+
+	/** Exception thrown when a required parameter was not given */
+	class MissingRequired : public ConstraintViolation {
+	public:
+		MissingRequired(const string &s, const vector<const Parameter*>& involved) :
+			ConstraintViolation(s, involved) {}
+		MissingRequired(const string &s) : ConstraintViolation(s) {}
+	};
+
 	Parameter(char shortOption, const char *longOption, 
 		  const char *description);
 
@@ -171,6 +963,11 @@ public:
 	/** Test whether the parameter has been set */
 	virtual bool isSet() const = 0;
 
+	/** Test whether the program gave the parameter a default value (see
+	 * PODParameter::setDefault()). Unlike isSet(), this is false for the
+	 * empty string a StringParameter starts out with. */
+	virtual bool hasDefault() const;
+
 
 	/** Attempt to down-cast to PODParameter<T>.
 	 *
@@ -192,8 +989,77 @@ public:
 	/** The short name of this parameter (e.g. "-o"), without the dash. */
 	char shortOption() const;
 
+	/** Test whether the parameter takes an argument (-oarg, -o arg or --option=arg)
+	 *
+	 * The parser uses this to decide where a cluster of short options ends.
+	 */
+	virtual bool takesArgument() const;
+
+	/** Append the parameter's value as it would be written on the command line,
+	 * such that parsing it gives the same value back (see ArgvBuilder).
+	 *
+	 * @return false if the parameter has no value, or its type has no text form
+	 */
+	virtual bool formatArgument(string& out) const;
+
+	/** Name of the parameter's type, e.g. "int" or "switch", for ParameterSet::exportConfig() */
+	virtual const char* typeName() const;
+
+	/** Require the parameter to be given on the command line */
+	void setRequired(bool required = true);
+	bool isRequired() const;
+
+	/** Mark the parameter's validation as slow, e.g. because it does I/O, so that
+	 * a parser with validation threads runs it in parallel with others
+	 * (see OptionsParser::setValidationThreads()). Its validate() must then be
+	 * safe to run at the same time as that of other parameters.
+	 */
+	void setExpensive(bool expensive = true);
+	bool isExpensive() const;
+
+	/** Position of the parameter in its ParameterSet (in order of addition) */
+	size_t index() const;
+
+	/** Forget whatever was set from the command line (see OptionsParser::reset()) */
+	virtual void reset();
+
+	/** Bits of switchState() */
+	enum {
+		STATE_SET = 1,		/**< Set from the command line */
+		STATE_PRESET = 2	/**< Set by the program, see PODParameter::setDefault() */
+	};
+
 protected:
 
+	/** The short and long forms of a usageLine(), padded to their columns */
+	static string usageColumns(const string& shortForm, const string& longForm);
+
+	/** The STATE_* bits that apply, for OptionsParser::snapshot() */
+	virtual unsigned switchState() const;
+	virtual void restoreSwitchState(unsigned state);
+
+	/** Append the parameter's value, in a form restoreValue() can read back.
+	 *
+	 * @return false if the parameter has no value (which is the default)
+	 */
+	virtual bool saveValue(string& out) const;
+
+	/** @return false if the data is malformed */
+	virtual bool restoreValue(const char* data, size_t length);
+
+	/** Whether restoreValue() would accept the data once the switch state is
+	 * state, found without changing anything. Override it along with
+	 * restoreValue(), which OptionsParser::restore() only calls once every
+	 * parameter has accepted its data. */
+	virtual bool canRestoreValue(const char* data, size_t length, unsigned state) const;
+
+	/** Size of the object, for ParameterSet::memoryUsage(). Subclasses that
+	 * add members should override it. */
+	virtual size_t objectSize() const;
+
+	/** Bytes the value holds outside of the object, for ParameterSet::memoryUsage() */
+	virtual size_t valueMemory() const;
+
 	/** Receive a potential parameter from the parser (and determien if it's ours)
 	 *
 	 * The parser will pass each potential parameter through it's registered parameters'
@@ -205,13 +1071,48 @@ protected:
 	 * 				   iterator that technically allows for more complex grammar than what is
 	 * 				   presently used.
 	 */
-	virtual bool receive(ParserState& state) throw(ParameterRejected) = 0;
+	virtual bool receive(ParserState& state) GETOPTPP_THROW(ParameterRejected) = 0;
 
-	friend class OptionsParser;
+	/** Test whether the parser may decode this parameter's options itself
+	 * (through receiveShort() and receiveLong()), which is what allows it to
+	 * appear in a cluster such as -xvf, and to be found through the long
+	 * option index. Parameters that don't are only ever offered whole tokens
+	 * through receive().
+	 *
+	 * CommonParameter returns true, so the parser no longer calls its
+	 * receive() for the options it decodes. A subclass that overrides
+	 * receive() to read its own syntax must override this to return false.
+	 */
+	virtual bool decodesShortOption() const;
+
+	/** Receive a short option that the parser has already matched against shortOption().
+	 *
+	 * Only called if decodesShortOption() is true.
+	 *
+	 * @param argument The argument of the option, or NULL if there was none.
+	 */
+	virtual void receiveShort(const string* argument) GETOPTPP_THROW(ParameterRejected);
 
+	/** Receive a long option that the parser has already matched against longOption().
+	 *
+	 * Only called if decodesShortOption() is true.
+	 *
+	 * @param argument What followed the '=', or NULL if there was none.
+	 */
+	virtual void receiveLong(const string* argument) GETOPTPP_THROW(ParameterRejected);
+
+	friend class OptionsParser;
+	friend class ParameterSet;
+
+	/* Ordered by size, so that the small members pack together. The long
+	 * name and the description point into a pool shared by every parameter,
+	 * which holds each distinct text once, and never moves or frees it. */
+	const string* flongOption;
+	const string* fdescription;
+	uint32_t findex;
 	char fshortOption;
-	const string flongOption;
-	const string fdescription;
+	bool frequired;
+	bool fexpensive;
 private:
 
 };
@@ -235,7 +1136,7 @@ class Switchable;
  */
 
 template<typename SwitchingBehavior=Switchable>
-class CommonParameter : public Parameter, protected SwitchingBehavior {
+class GETOPTPP_API CommonParameter : public Parameter, protected SwitchingBehavior {
 public:
 
 	/** Test whether the parameter has been set */
@@ -247,32 +1148,48 @@ public:
 
 	virtual string usageLine() const;
 
+	virtual void reset();
 protected:
+	virtual unsigned switchState() const;
+	virtual void restoreSwitchState(unsigned state);
+
+	virtual size_t objectSize() const;
+
 	/** Parse the argument given by state, and dispatch either
 	 * receiveSwitch() or receiveArgument() accordingly.
 	 *
 	 * @param state The current argument being parsed.
 	 */
-	virtual bool receive(ParserState& state) throw(ParameterRejected);
+	virtual bool receive(ParserState& state) GETOPTPP_THROW(ParameterRejected);
+
+	virtual bool decodesShortOption() const;
+
+	/** Dispatch receiveSwitch() or receiveArgument() for an already matched
+	 * short option.
+	 */
+	virtual void receiveShort(const string* argument) GETOPTPP_THROW(ParameterRejected);
+
+	/** The same, for an already matched long option */
+	virtual void receiveLong(const string* argument) GETOPTPP_THROW(ParameterRejected);
 
 	/**
 	 * Called when a parameter does not have an argument, e.g.
 	 * either -f or --foo
 	 */
-	virtual void receiveSwitch() throw (ParameterRejected) = 0;
+	virtual void receiveSwitch() GETOPTPP_THROW(ParameterRejected) = 0;
 
 	/**
 	 * Called when a parameter does have an argument, .e.g
 	 * -fbar or --foo=bar
 	 */
-	virtual void receiveArgument(const string& argument) throw (ParameterRejected) = 0;
+	virtual void receiveArgument(const string& argument) GETOPTPP_THROW(ParameterRejected) = 0;
 };
 
 /** This class (used as a mixin) defines how a parameter
  * behaves when switched on, specifically when switched on multiple times.
  *
  */
-class Switchable {
+class GETOPTPP_API Switchable {
 public:
 	class SwitchingError : public Parameter::ParameterRejected {};
 
@@ -282,7 +1199,14 @@ public:
 	/** Set the parameter
 	 *
 	 */
-	virtual void set() throw (SwitchingError) = 0;
+	virtual void set() GETOPTPP_THROW(SwitchingError) = 0;
+
+	/** Forget that the parameter was set */
+	virtual void reset();
+
+	/** The Parameter::STATE_* bits that apply */
+	virtual unsigned state() const;
+	virtual void restoreState(unsigned state);
 
 	virtual ~Switchable();
 	Switchable();
@@ -291,10 +1215,10 @@ protected:
 };
 
 /** Switching behavior that does not complain when set multiple times. */
-class MultiSwitchable : public Switchable {
+class GETOPTPP_API MultiSwitchable : public Switchable {
 public:
 	virtual ~MultiSwitchable();
-	virtual void set() throw(SwitchingError);
+	virtual void set() GETOPTPP_THROW(SwitchingError);
 
 };
 
@@ -303,7 +1227,7 @@ public:
  * This is typically what you want if your parameter has an argument.
  *
  */
-class UniquelySwitchable : public Switchable {
+class GETOPTPP_API UniquelySwitchable : public Switchable {
 public:
 
 	virtual ~UniquelySwitchable();
@@ -312,7 +1236,7 @@ public:
 	 *
 	 * @throw SwitchingError Thrown if the parameter is already set.
 	 */
-	virtual void set() throw (SwitchingError);
+	virtual void set() GETOPTPP_THROW(SwitchingError);
 };
 
 /** Switching behavior that makes possible allows presettable parameters,
@@ -322,7 +1246,7 @@ public:
  *
  *
  */
-class PresettableUniquelySwitchable : public UniquelySwitchable {
+class GETOPTPP_API PresettableUniquelySwitchable : public UniquelySwitchable {
 public:
 
 	/** Test whether the parameter has been set OR preset */
@@ -333,28 +1257,248 @@ public:
 	 * @throw SwitchingError thrown if the parameter is already set
 	 * (doesn't care if it's been pre-set)
 	 */
-	virtual void set() throw (Switchable::SwitchingError);
+	virtual void set() GETOPTPP_THROW(Switchable::SwitchingError);
 
 	/** Call if the parameter has been preset */
 	virtual void preset();
 
+	/** Preset by the parameter itself rather than by the program, e.g. the
+	 * empty string of a StringParameter: isSet(), but not presetByProgram() */
+	void presetImplicitly();
+
+	/** Test whether preset() has been called */
+	bool presetByProgram() const;
+
+	virtual unsigned state() const;
+	virtual void restoreState(unsigned state);
+
+	PresettableUniquelySwitchable();
 	virtual ~PresettableUniquelySwitchable();
 private:
-	MultiSwitchable fpreset;
+	bool fpreset;
+
+	/** Preset through presetImplicitly() only. Not part of state(), as it
+	 * is up to the program, like the default value itself. */
+	bool fimplicit;
 };
 
 /* Parameter that does not take an argument, and throws an exception
  * if an argument is given */
 
-class SwitchParameter : public CommonParameter<MultiSwitchable> {
+class GETOPTPP_API SwitchParameter : public CommonParameter<MultiSwitchable> {
 public:
 	SwitchParameter(char shortOption, const char *longOption,
 			const char* description);
 	virtual ~SwitchParameter();
 
+	virtual bool takesArgument() const;
+
+	virtual const char* typeName() const;
 protected:
-	virtual void receiveSwitch() throw (Parameter::ParameterRejected);
-	virtual void receiveArgument(const string& argument) throw (Parameter::ParameterRejected);
+	virtual void receiveSwitch() GETOPTPP_THROW(Parameter::ParameterRejected);
+	virtual void receiveArgument(const string& argument) GETOPTPP_THROW(Parameter::ParameterRejected);
+};
+
+/** Binary encoding of parameter values, for OptionsParser::snapshot().
+ *
+ * Arithmetic and enumeration types are saved as their bytes, in host byte
+ * order, so that a saved value only reads back on the same architecture.
+ * Other types need a specialization (string and the types of units.h have
+ * one), or can't be saved: a struct's bytes may hold padding or pointers
+ * that mean nothing to another process.
+ */
+template<typename T>
+struct ValueCodec {
+	static const bool supported = std::is_arithmetic<T>::value || std::is_enum<T>::value;
+
+	static void encode(const T& value, string& out) {
+		out.append((const char*) &value, sizeof(T));
+	}
+
+	/** @return false if length is wrong for the type */
+	static bool decode(const char* data, size_t length, T& value) {
+		if(length != sizeof(T)) return false;
+		memcpy((void*) &value, data, sizeof(T));
+		return true;
+	}
+
+	/** Bytes the value holds outside of itself, see MemoryUsage */
+	static size_t heapBytes(const T&) { return 0; }
+};
+
+template<>
+struct ValueCodec<string> {
+	static const bool supported = true;
+
+	static void encode(const string& value, string& out) { out.append(value); }
+
+	static size_t heapBytes(const string& value) { return MemoryUsage::heap(value); }
+
+	static bool decode(const char* data, size_t length, string& value) {
+		value.assign(data, length);
+		return true;
+	}
+};
+
+/** Conversion of arguments to values, for the types PODParameter::validate()
+ * handles itself: int, long, double and string here, and the types of units.h.
+ *
+ * Failure is returned rather than thrown, so that a parse collecting its
+ * errors doesn't pay for an exception per bad argument (see
+ * PODParameter::tryValidate()). Other types specialize validate() instead;
+ * a PODParameter<T> that does neither fails to compile, unless T is an
+ * enumeration, which EnumParameter validates.
+ */
+template<typename T>
+struct ValueParser {
+	static const bool supported = false;
+
+	/** @return false, with the reason in error, if s isn't a valid value */
+	static bool parse(const string& /* s */, T& /* value */, string& /* error */) { return false; }
+};
+
+template<>
+struct GETOPTPP_API ValueParser<int> {
+	static const bool supported = true;
+	static bool parse(const string& s, int& value, string& error);
+};
+
+template<>
+struct GETOPTPP_API ValueParser<long> {
+	static const bool supported = true;
+	static bool parse(const string& s, long& value, string& error);
+};
+
+template<>
+struct GETOPTPP_API ValueParser<double> {
+	static const bool supported = true;
+	static bool parse(const string& s, double& value, string& error);
+};
+
+template<>
+struct ValueParser<string> {
+	static const bool supported = true;
+
+	static bool parse(const string& s, string& value, string&) {
+		value = s;
+		return true;
+	}
+};
+
+/** Where an argument rejected during a parse that collects its errors is
+ * reported, rather than thrown (see PODParameter::tryValidate()) */
+class GETOPTPP_API RejectedArgument {
+public:
+	/** Take the rejections of the parse on this thread (if collect is set),
+	 * until the end of the object's life */
+	RejectedArgument(bool collect);
+	~RejectedArgument();
+
+	/** Where rejections are reported on this thread, or NULL if they are thrown */
+	static RejectedArgument* active();
+
+	/** Report that the current argument was rejected */
+	void reject(const string& what);
+
+	/** Whether an argument was rejected since the object was made */
+	bool rejected() const;
+
+	/** Why it was rejected */
+	const string& what() const;
+private:
+	RejectedArgument(const RejectedArgument&);
+
+	bool fcollect;
+	RejectedArgument* fprevious;
+	bool frejected;
+	string fwhat;
+};
+
+/** The validation deferred during a parse, see OptionsParser::setValidationThreads() */
+class GETOPTPP_API DeferredValidation {
+public:
+	/** An argument to validate */
+	class GETOPTPP_API Job {
+	public:
+		Job(const Parameter& parameter);
+		virtual ~Job();
+
+		/** Validate the argument. Runs on any thread. */
+		virtual void run() = 0;
+
+		/** Store the validated value. Runs on the parsing thread, in argv order,
+		 * and again if the parse is replayed (see replay()). */
+		virtual void apply() = 0;
+
+		/** Undo what the scan did for an argument that failed validation, so
+		 * that it doesn't count as given. Runs on the parsing thread. */
+		virtual void reject();
+	private:
+		friend class DeferredValidation;
+
+		/** run(), catching what it throws */
+		void execute();
+
+		const Parameter& fparameter;
+		int fposition;
+		bool flongForm;
+		bool ffailed;
+		ParseError::Kind fkind;
+		string fwhat;
+		std::exception_ptr fexception;
+		/** The rejection reworded, thrown by finish() when not collecting */
+		std::exception_ptr frejection;
+	};
+
+	/** Defer the validation of the parse on this thread (if threads isn't 0),
+	 * until finish() or the end of the object's life */
+	DeferredValidation(unsigned threads);
+	~DeferredValidation();
+
+	/** The validation deferred on this thread, or NULL if validation isn't deferred */
+	static DeferredValidation* active();
+
+	/** The parser is at the given argument */
+	void at(int position, const string& argument);
+
+	/** Take a job for the current argument */
+	void add(Job* job);
+
+	/** Run the jobs, and apply their results in argv order.
+	 *
+	 * A job that fails with an error that is thrown (always when errors is
+	 * NULL) stops this where a serial parse would have stopped: the jobs
+	 * before it are applied, and it and the ones after it are rejected.
+	 * The arguments the scan took after it are left to the caller, see replay().
+	 *
+	 * @param errors Where to add the errors, or NULL to throw the first one
+	 * @param rejected Where to list the parameters whose argument failed, or NULL
+	 */
+	void finish(ParseErrors* errors, vector<const Parameter*>* rejected = NULL);
+
+	/** Prepare for the arguments to be scanned again from the start, after
+	 * finish() threw the error of a job.
+	 *
+	 * The jobs added by the new scan take the results of the ones before the
+	 * failed job, rather than being run again; from the failed one on, they
+	 * are run as they are added, so that the scan stops as a serial one would.
+	 *
+	 * @return false if no job failed (or this is already a replay)
+	 */
+	bool replay();
+private:
+	DeferredValidation(const DeferredValidation&);
+
+	unsigned fthreads;
+	DeferredValidation* fprevious;
+	vector<Job*> fjobs;
+	int fposition;
+	bool flongForm;
+
+	/** The first job that failed in finish(), or fjobs.size() */
+	size_t ffailed;
+	/** Jobs taken again by replay()'s scan, or -1 when not replaying */
+	size_t freplayed;
 };
 
 /** Plain-Old-Data parameter. Performs input validation.
@@ -366,7 +1510,7 @@ protected:
  */
 
 template<typename T>
-class PODParameter : public CommonParameter<PresettableUniquelySwitchable> {
+class GETOPTPP_API PODParameter : public CommonParameter<PresettableUniquelySwitchable> {
 public:
 	PODParameter(char shortOption, const char *longOption,
 			const char* description);
@@ -383,18 +1527,94 @@ public:
 	/** Set a default value for this parameter */
 	virtual void setDefault(T value);
 
+	virtual bool hasDefault() const;
+
 	std::string usageLine() const;
+
+	virtual bool takesArgument() const;
+
+	/** Forget the value from the command line, going back to the default (if any) */
+	virtual void reset();
+
+	/** Formats int, long, double and string values; other types need a specialization */
+	virtual bool formatArgument(string& out) const;
+
+	/** "value" unless specialized, as it is for the types this file and units.cc handle */
+	virtual const char* typeName() const;
+
+	typedef T value_type;
+
+	/** Decode the value from what saveValue() wrote (e.g. as found in a SnapshotView)
+	 *
+	 * @return false if the data is malformed
+	 */
+	static bool loadValue(const char* saved, size_t length, T& value);
 protected:
 	/** Validation function for the data type.
+	 *
+	 * Uses ValueParser<T> unless specialized.
 	 *
 	 * @throw ParameterRejected if the argument does not conform to this data type.
 	 * @return the value corresponding to the argument.
 	 */
-	virtual T validate(const string& s) throw (ParameterRejected);
-	virtual void receiveArgument(const string &argument) throw(ParameterRejected);
-	virtual void receiveSwitch() throw (Parameter::ParameterRejected);
+	virtual T validate(const string& s) GETOPTPP_THROW(ParameterRejected);
+
+	/** validate() for a parse that collects its errors, returning false with
+	 * the reason in error instead of throwing ParameterRejected.
+	 *
+	 * Goes straight to ValueParser<T> where validate() is known to be the
+	 * default, and otherwise catches what validate() throws. Subclasses with
+	 * a cheaper way to fail override it, taking the same care (see validatesAs()).
+	 */
+	virtual bool tryValidate(const string& s, T& value, string& error);
+
+	/** Whether validate() is the one of class P, i.e. no subclass of P may
+	 * have overridden it. A tryValidate() that bypasses validate() must
+	 * otherwise fall back to catchValidate(). */
+	template<class P>
+	bool validatesAs() const { return typeid(*this) == typeid(P); }
+
+	/** tryValidate() by calling validate() and catching ParameterRejected */
+	bool catchValidate(const string& s, T& value, string& error);
+	virtual void receiveArgument(const string &argument) GETOPTPP_THROW(ParameterRejected);
+	virtual void receiveSwitch() GETOPTPP_THROW(Parameter::ParameterRejected);
+
+	virtual bool saveValue(string& out) const;
+	virtual bool restoreValue(const char* data, size_t length);
+	virtual bool canRestoreValue(const char* data, size_t length, unsigned state) const;
+
+	/** Decode the records saveValue() writes for a parameter in the given
+	 * switch state: the value, and fallback too if it has two. V is T, or
+	 * another type with the same encoding. */
+	template<typename V>
+	static bool decodeValues(const char* data, size_t length, unsigned state, V& value, V& fallback);
+
+	virtual size_t objectSize() const;
+	virtual size_t valueMemory() const;
+
+	/** Called after value has been stored: from an argument (also when its
+	 * validation was deferred), a snapshot, setDefault() or reset() */
+	virtual void valueChanged();
+
+	/** Deferred validate(), see DeferredValidation */
+	class ValidationJob : public DeferredValidation::Job {
+	public:
+		ValidationJob(PODParameter& parameter, const string& argument);
+
+		virtual void run();
+		virtual void apply();
+		virtual void reject();
+	private:
+		PODParameter& fparameter;
+		const string fargument;
+		T fresult;
+
+		/** The parameter's switch state before the argument */
+		unsigned fstate;
+	};
 
 	T value;
+	T fdefault;
 };
 
 
@@ -403,8 +1623,74 @@ typedef PODParameter<long> LongParameter;
 typedef PODParameter<double> DoubleParameter;
 typedef PODParameter<string> StringParameter;
 
+template<> PODParameter<string>::PODParameter(char shortOption, const char *longOption,
+		const char* description);
+template<> bool PODParameter<int>::formatArgument(string& out) const;
+template<> bool PODParameter<long>::formatArgument(string& out) const;
+template<> bool PODParameter<double>::formatArgument(string& out) const;
+template<> bool PODParameter<string>::formatArgument(string& out) const;
+template<> const char* PODParameter<int>::typeName() const;
+template<> const char* PODParameter<long>::typeName() const;
+template<> const char* PODParameter<double>::typeName() const;
+template<> const char* PODParameter<string>::typeName() const;
+
+/** Parameter that accepts one out of a fixed set of names, each mapped to a value of E.
+ *
+ * The names are given to setValues() as a table, typically a static array:
+ *
+ *	static const EnumParameter<Codec>::Value codecs[] = {
+ *		{ "h264", H264 }, { "vp9", VP9 }, { "av1", AV1 }
+ *	};
+ *	ps.add<EnumParameter<Codec> >('c', "codec", "Video codec").setValues(codecs);
+ *
+ * The table is not copied, and must outlive the parameter.
+ */
+template<typename E>
+class GETOPTPP_API EnumParameter : public PODParameter<E> {
+public:
+	struct Value {
+		const char* name;
+		E value;
+	};
+
+	EnumParameter(char shortOption, const char *longOption,
+			const char* description);
+	virtual ~EnumParameter();
+
+	/** Set the accepted names.
+	 *
+	 * @param ignoreCase Match the names without regard to (ASCII) case.
+	 */
+	EnumParameter& setValues(const Value* values, size_t count, bool ignoreCase = false);
+
+	template<size_t N>
+	EnumParameter& setValues(const Value (&values)[N], bool ignoreCase = false);
+
+	/** The name corresponding to a value, or NULL if there is none */
+	const char* nameOf(E value) const;
+
+	virtual bool formatArgument(string& out) const;
+
+	virtual const char* typeName() const;
+
+	string usageLine() const;
+protected:
+	virtual E validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected);
+	virtual bool tryValidate(const string& s, E& value, string& error);
+
+	virtual size_t objectSize() const;
+
+	const Value* fvalues;
+	size_t fcount;
+	EnumMatcher fmatcher;
+};
+
 #include "parameter.include.cc"
 
 } //namespace
 
+#ifndef GETOPTPP_NO_IOSTREAM
+#include "streams.h"
+#endif
+
 #endif
@@ -0,0 +1,371 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "glob.h"
+
+namespace vlofgren {
+
+/*
+ *
+ * Class GlobExpander
+ *
+ *
+ */
+
+namespace {
+
+/** A pattern split into components */
+struct GlobComponent {
+	string text;
+	bool wild;	/**< Has wildcards, so the directory must be listed */
+	bool any;	/**< Is "**" */
+};
+
+/** A directory to match a component against */
+struct GlobTask {
+	string directory;	/**< Empty, or ending with '/' */
+	size_t component;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+
+/** State shared by the threads of one expand() */
+class GlobWalk {
+public:
+	GlobWalk(const vector<GlobComponent>& components, GlobExpander::Sink& sink) :
+		fcomponents(components), fsink(sink), fbusy(0), fmatched(false) {}
+
+	void push(const GlobTask& task) {
+		fqueue.push_back(task);
+	}
+
+	/** Run the tasks on this thread for as long as there is only one at a
+	 * time, which is all a pattern with a single wildcard component needs.
+	 *
+	 * @return false if there are no tasks left
+	 */
+	bool start() {
+		vector<GlobTask> more;
+		while(fqueue.size() == 1) {
+			GlobTask task = fqueue.front();
+			fqueue.pop_front();
+			run(task, more);
+			fqueue.insert(fqueue.end(), more.begin(), more.end());
+			more.clear();
+		}
+		return !fqueue.empty();
+	}
+
+	/** Take tasks until every directory has been walked */
+	void work() {
+		vector<GlobTask> more;
+
+		unique_lock<mutex> lock(flock);
+		for(;;) {
+			while(fqueue.empty() && fbusy) fwake.wait(lock);
+			if(fqueue.empty()) break;
+
+			GlobTask task = fqueue.front();
+			fqueue.pop_front();
+			fbusy++;
+			lock.unlock();
+
+			run(task, more);
+
+			lock.lock();
+			fbusy--;
+			fqueue.insert(fqueue.end(), more.begin(), more.end());
+			more.clear();
+			fwake.notify_all();
+		}
+	}
+
+	/** Whether anything matched. Rethrows what the sink threw. */
+	bool finish() {
+		if(ffailure) std::rethrow_exception(ffailure);
+		return fmatched;
+	}
+private:
+	void run(const GlobTask& task, vector<GlobTask>& more);
+
+	/** Pass a match to the sink. Once the sink has thrown, the rest are dropped. */
+	void found(const string& path) {
+		lock_guard<mutex> lock(fsinkLock);
+		fmatched = true;
+		if(ffailure) return;
+
+		try {
+			fsink.match(path.data(), path.size());
+		} catch(...) {
+			ffailure = std::current_exception();
+		}
+	}
+
+	const vector<GlobComponent>& fcomponents;
+	GlobExpander::Sink& fsink;
+
+	mutex flock;
+	condition_variable fwake;
+	deque<GlobTask> fqueue;
+
+	/** Tasks being run, which may add more */
+	unsigned fbusy;
+
+	mutex fsinkLock;
+	bool fmatched;
+	std::exception_ptr ffailure;
+};
+
+bool isDirectory(const string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+void GlobWalk::run(const GlobTask& task, vector<GlobTask>& more) {
+	const GlobComponent& c = fcomponents[task.component];
+	bool last = task.component + 1 == fcomponents.size();
+
+	if(c.any) {
+		/* No directory at all, and then one more level for each subdirectory */
+		GlobTask next = { task.directory, task.component + 1 };
+		more.push_back(next);
+	} else if(!c.wild) {
+		string path = task.directory + c.text;
+		if(last) {
+			struct stat st;
+			if(c.text.empty() ? !task.directory.empty() : lstat(path.c_str(), &st) == 0) found(path);
+		} else if(isDirectory(path)) {
+			GlobTask next = { path + "/", task.component + 1 };
+			more.push_back(next);
+		}
+		return;
+	}
+
+	DIR* dir = opendir(task.directory.empty() ? "." : task.directory.c_str());
+	if(!dir) return;
+
+	while(struct dirent* entry = readdir(dir)) {
+		const char* name = entry->d_name;
+		if(name[0] == '.' && (c.any || c.text[0] != '.')) continue;
+		if(name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+
+		string path = task.directory + name;
+		if(c.any) {
+			/* Don't follow symbolic links here, which could form cycles */
+			bool directory = entry->d_type == DT_DIR;
+			if(entry->d_type == DT_UNKNOWN) {
+				struct stat st;
+				directory = lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+			}
+			if(directory) {
+				GlobTask next = { path + "/", task.component };
+				more.push_back(next);
+			}
+		} else if(GlobExpander::matchComponent(c.text.data(), c.text.size(), name)) {
+			if(last) found(path);
+			else if(entry->d_type == DT_DIR || ((entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) && isDirectory(path))) {
+				GlobTask next = { path + "/", task.component + 1 };
+				more.push_back(next);
+			}
+		}
+	}
+
+	closedir(dir);
+}
+
+#endif
+
+/** Collects the matches for expand(pattern, matches) */
+class GlobVector : public GlobExpander::Sink {
+public:
+	GlobVector(vector<string>& matches) : fmatches(matches) {}
+
+	virtual void match(const char* path, size_t length) {
+		fmatches.push_back(string(path, length));
+	}
+private:
+	vector<string>& fmatches;
+};
+
+}
+
+GlobExpander::GlobExpander(unsigned threads) : fthreads(threads) {
+	if(!fthreads) fthreads = thread::hardware_concurrency();
+	if(!fthreads) fthreads = 1;
+}
+
+bool GlobExpander::isPattern(const char* s, size_t length) {
+	for(size_t i = 0; i < length; i++) {
+		if(s[i] == '*' || s[i] == '?' || s[i] == '[') return true;
+	}
+	return false;
+}
+
+bool GlobExpander::matchComponent(const char* pattern, size_t patternLength, const char* name) {
+	const char* p = pattern;
+	const char* end = pattern + patternLength;
+
+	/* Where to resume after the last '*' if the rest fails to match */
+	const char* starPattern = NULL;
+	const char* starName = NULL;
+
+	while(*name) {
+		if(p != end && *p == '*') {
+			starPattern = ++p;
+			starName = name;
+			continue;
+		}
+
+		if(p != end) {
+			bool matched = false;
+			const char* next = p + 1;
+
+			if(*p == '?') {
+				matched = true;
+			} else if(*p == '[') {
+				const char* q = p + 1;
+				bool negate = q != end && (*q == '!' || *q == '^');
+				if(negate) q++;
+
+				/* A ']' right after the '[' is taken literally */
+				const char* close = q;
+				if(close != end && *close == ']') close++;
+				while(close != end && *close != ']') close++;
+
+				if(close == end) {
+					matched = *name == '[';
+				} else {
+					bool in = false;
+					for(; q != close; q++) {
+						if(q + 2 < close && q[1] == '-') {
+							if((unsigned char) *name >= (unsigned char) q[0] && (unsigned char) *name <= (unsigned char) q[2]) in = true;
+							q += 2;
+						} else if(*q == *name) {
+							in = true;
+						}
+					}
+					matched = in != negate;
+					next = close + 1;
+				}
+			} else {
+				matched = *p == *name;
+			}
+
+			if(matched) {
+				p = next;
+				name++;
+				continue;
+			}
+		}
+
+		if(!starPattern) return false;
+		p = starPattern;
+		name = ++starName;
+	}
+
+	while(p != end && *p == '*') p++;
+	return p == end;
+}
+
+bool GlobExpander::expand(const string& pattern, Sink& sink) const {
+#if defined(__unix__) || defined(__APPLE__)
+	vector<GlobComponent> components;
+	GlobTask root = { string(), 0 };
+
+	string::size_type start = 0;
+	if(!pattern.empty() && pattern[0] == '/') {
+		root.directory = "/";
+		start = 1;
+	}
+
+	/* Leading components without wildcards just become the directory to start in */
+	bool literal = true;
+	for(;;) {
+		string::size_type slash = pattern.find('/', start);
+		GlobComponent c;
+		c.text = pattern.substr(start, slash == string::npos ? string::npos : slash - start);
+		c.any = c.text == "**";
+		c.wild = c.any || isPattern(c.text.data(), c.text.size());
+
+		if(slash == string::npos) {
+			/* A trailing "**" matches everything below */
+			if(c.any) {
+				components.push_back(c);
+				c.text = "*";
+				c.any = false;
+			}
+			components.push_back(c);
+			break;
+		}
+
+		if(literal && !c.wild) root.directory += c.text + "/";
+		else if(!c.text.empty()) components.push_back(c);
+		literal = literal && !c.wild;
+		start = slash + 1;
+	}
+
+	GlobWalk walk(components, sink);
+	walk.push(root);
+
+	if(walk.start()) {
+		/* The calling thread walks too, so helpers that can't be started only slow things down */
+		vector<thread> helpers;
+		helpers.reserve(fthreads - 1);
+		for(unsigned i = 1; i < fthreads; i++) {
+			try {
+				helpers.push_back(thread(&GlobWalk::work, &walk));
+			} catch(std::system_error &e) {
+				break;
+			}
+		}
+		walk.work();
+		for(size_t i = 0; i < helpers.size(); i++) helpers[i].join();
+	}
+
+	return walk.finish();
+#else
+	return false;
+#endif
+}
+
+bool GlobExpander::expand(const string& pattern, vector<string>& matches) const {
+	size_t before = matches.size();
+	GlobVector sink(matches);
+	if(!expand(pattern, sink)) return false;
+
+	/* The threads find the matches in no particular order, and two "**" in
+	 * a row reach the same path more than once */
+	sort(matches.begin() + before, matches.end());
+	matches.erase(unique(matches.begin() + before, matches.end()), matches.end());
+	return true;
+}
+
+} //namespace
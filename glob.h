@@ -0,0 +1,80 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+#include "getoptpp.h"
+
+#ifndef GETOPTPP_GLOB_H
+#define GETOPTPP_GLOB_H
+
+namespace vlofgren {
+
+/** Expands shell-style patterns against the file system, see
+ * OptionsParser::setGlobExpansion().
+ *
+ * A pattern is split at '/' into components, each of which may use '*',
+ * '?' and '[...]' (with '!' or '^' for negation, and ranges like a-z).
+ * A component that is exactly "**" matches any number of nested directories,
+ * including none. As in the shell, wildcards don't match names starting
+ * with '.', and "**" doesn't descend into hidden directories or follow
+ * symbolic links to directories.
+ *
+ * The directories are walked by a pool of threads, or by the calling thread
+ * alone if no more can be started. Only Unix-like systems are supported;
+ * elsewhere nothing matches.
+ */
+class GETOPTPP_API GlobExpander {
+public:
+	/** Receives the paths expand() finds */
+	class GETOPTPP_API Sink {
+	public:
+		virtual ~Sink() {}
+
+		/** Called for each match as it is found, by one thread at a time */
+		virtual void match(const char* path, size_t length) = 0;
+	};
+
+	/** @param threads Threads to walk with, 0 for one per core */
+	GlobExpander(unsigned threads = 0);
+
+	/** Test whether s contains any wildcards */
+	static bool isPattern(const char* s, size_t length);
+
+	/** Pass the paths matching pattern to sink, in no particular order. A
+	 * path is passed more than once if the pattern has "**" twice in a row.
+	 * What the sink throws is rethrown once the walk has stopped.
+	 *
+	 * @return false if nothing matched
+	 */
+	bool expand(const string& pattern, Sink& sink) const;
+
+	/** Append the paths matching pattern to matches, sorted bytewise, each once.
+	 *
+	 * @return false if nothing matched
+	 */
+	bool expand(const string& pattern, vector<string>& matches) const;
+
+	/** Match a single file name against a single component of a pattern */
+	static bool matchComponent(const char* pattern, size_t patternLength, const char* name);
+private:
+	unsigned fthreads;
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,160 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "incremental.h"
+
+namespace vlofgren {
+
+/*
+ *
+ * Class IncrementalParser
+ *
+ *
+ */
+
+IncrementalParser::IncrementalParser(OptionsParser& parser) :
+	fparser(parser), fposition(0), fbegun(false), fended(false) {}
+
+void IncrementalParser::begin(const string& programName) {
+	fparser.beginArguments(programName);
+
+	fwindow.clear();
+	fevents.clear();
+	fposition = 0;
+	fbegun = true;
+	fended = false;
+}
+
+void IncrementalParser::feed(const string& token) {
+	if(!fbegun) begin(string());
+	fposition++;
+
+	if(fended) {
+		size_t files = fparser.fileCount();
+		fparser.receiveFile(token.data(), token.size());
+		collect(fposition, files);
+		return;
+	}
+
+	fwindow.push_back(token);
+	if(fwindow.size() == 1 && needsArgument(token)) return;
+
+	dispatch();
+}
+
+void IncrementalParser::finish() {
+	if(!fbegun) begin(string());
+	if(!fwindow.empty()) dispatch();
+
+	fparser.parameters.checkConstraints(fparser.fgiven, fparser.frequired, &ferrors);
+	collect(-1, fparser.fileCount());
+
+	fbegun = false;
+}
+
+bool IncrementalParser::poll(ParseEvent& event) {
+	if(fevents.empty()) return false;
+
+	event = fevents.front();
+	fevents.pop_front();
+	return true;
+}
+
+bool IncrementalParser::ended() const {
+	return fended;
+}
+
+bool IncrementalParser::needsArgument(const string& token) const {
+	if(token.length() < 2 || token[0] != '-' || token[1] == '-') return false;
+
+	/* Same walk as OptionsParser::receiveShortCluster() */
+	for(string::size_type pos = 1; pos < token.length(); pos++) {
+		const Parameter* p = fparser.shortIndex(token[pos]);
+		if(!p) return false;
+		if(p->takesArgument()) return pos + 1 == token.length();
+	}
+
+	return false;
+}
+
+void IncrementalParser::dispatch() {
+	ParserState state(fparser, fwindow, fposition - fwindow.size());
+
+	for(; !state.end(); state.advance()) {
+		int position = state.position();
+		size_t files = fparser.fileCount();
+
+		fparser.fmatched = &fmatched;
+		bool more;
+		try {
+			more = fparser.dispatchArgument(state, &ferrors);
+		} catch(...) {
+			fparser.fmatched = NULL;
+			throw;
+		}
+		fparser.fmatched = NULL;
+
+		if(!more) {
+			fended = true;
+			for(; !state.end(); state.advance()) fparser.receiveFile(state.get().data(), state.get().size());
+			collect(position, files);
+			break;
+		}
+
+		collect(position, files);
+	}
+
+	fwindow.clear();
+}
+
+void IncrementalParser::collect(int position, size_t files) {
+	ParseEvent event;
+	event.position = position;
+
+	for(size_t i = 0; i < fmatched.size(); i++) {
+		event.kind = ParseEvent::OPTION;
+		event.parameter = fmatched[i];
+		event.value.clear();
+		if(fmatched[i]->takesArgument()) fmatched[i]->formatArgument(event.value);
+		fevents.push_back(event);
+	}
+
+	for(size_t i = 0; i < ferrors.size(); i++) {
+		event.kind = ParseEvent::PARSE_ERROR;
+		event.position = ferrors[i].position;
+		event.parameter = ferrors[i].parameter;
+		event.value.clear();
+		event.error = ferrors[i];
+		fevents.push_back(event);
+	}
+
+	event.position = position;
+	event.parameter = NULL;
+	for(size_t i = files; i < fparser.fileCount(); i++) {
+		size_t length;
+		const char* name = fparser.file(i, length);
+		event.kind = ParseEvent::POSITIONAL;
+		event.value.assign(name, length);
+		fevents.push_back(event);
+	}
+
+	fmatched.clear();
+	ferrors.clear();
+}
+
+} //namespace
@@ -0,0 +1,207 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "getoptpp.h"
+#include <deque>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#define GETOPTPP_HAVE_GENERATOR 1
+#endif
+#endif
+
+#ifndef GETOPTPP_INCREMENTAL_H
+#define GETOPTPP_INCREMENTAL_H
+
+namespace vlofgren {
+
+/** Something an IncrementalParser found in the tokens fed to it */
+struct ParseEvent {
+	enum Kind {
+		OPTION,		/**< A parameter was given */
+		POSITIONAL,	/**< A non-option argument, see OptionsParser::getFiles() */
+		PARSE_ERROR	/**< A problem, see error */
+	};
+
+	Kind kind;
+
+	/** Index of the token in the command line (the first token fed is 1), or -1 */
+	int position;
+
+	/** The parameter of an OPTION */
+	const Parameter* parameter;
+
+	/** The value an OPTION was given (see Parameter::formatArgument()), or
+	 * the POSITIONAL argument itself */
+	string value;
+
+	/** The problem found, for PARSE_ERROR */
+	ParseError error;
+};
+
+/** Parses a command line that arrives one token at a time, e.g. from a pipe
+ * or a socket, using the parameters and the matching of an OptionsParser.
+ *
+ *	IncrementalParser inc(optp);
+ *	inc.begin("tool");
+ *	while(readToken(token)) {
+ *		inc.feed(token);
+ *		while(inc.poll(event)) handle(event);
+ *	}
+ *	inc.finish();
+ *	while(inc.poll(event)) handle(event);
+ *
+ * Parsing ends up just where OptionsParser::parse(int, const char*[], ParseErrors&)
+ * would for the same tokens, and the parser can be read as usual afterwards.
+ * Only a token that ends in a short option expecting its argument (-o) is
+ * held back until the next one arrives; nothing else is buffered.
+ */
+class GETOPTPP_API IncrementalParser {
+public:
+	IncrementalParser(OptionsParser& parser);
+
+	/** Start a new command line, resetting the parser (see OptionsParser::reset()) */
+	void begin(const string& programName);
+
+	/** Parse the next token */
+	void feed(const string& token);
+
+	/** End the command line, which parses a token still held back and
+	 * checks the required parameters and the constraints */
+	void finish();
+
+	/** Take the oldest event not taken yet
+	 *
+	 * @return false if there is none
+	 */
+	bool poll(ParseEvent& event);
+
+	/** Test whether "--" ended the options, so that every further token is positional */
+	bool ended() const;
+private:
+	/** Test whether the token ends in a short option that takes the next token as its argument */
+	bool needsArgument(const string& token) const;
+
+	/** Parse the held tokens */
+	void dispatch();
+
+	/** Turn what the last argument did to the parser into events */
+	void collect(int position, size_t files);
+
+	OptionsParser& fparser;
+
+	/** The token held back, followed by the one that completes it */
+	vector<string> fwindow;
+
+	/** Number of tokens fed so far */
+	int fposition;
+
+	bool fbegun;
+	bool fended;
+
+	deque<ParseEvent> fevents;
+	ParseErrors ferrors;
+	vector<const Parameter*> fmatched;
+};
+
+#ifdef GETOPTPP_HAVE_GENERATOR
+
+/** Minimal C++20 generator, for parseEvents() */
+template<typename T>
+class Generator {
+public:
+	struct promise_type {
+		const T* fvalue;
+		std::exception_ptr fexception;
+
+		Generator get_return_object() { return Generator(handle::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+		std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+		std::suspend_always yield_value(const T& value) noexcept {
+			fvalue = &value;
+			return std::suspend_always();
+		}
+		void return_void() {}
+		void unhandled_exception() { fexception = std::current_exception(); }
+	};
+
+	typedef std::coroutine_handle<promise_type> handle;
+
+	class iterator {
+	public:
+		explicit iterator(handle h) : fhandle(h) {}
+
+		iterator& operator++() {
+			Generator::resume(fhandle);
+			return *this;
+		}
+		const T& operator*() const { return *fhandle.promise().fvalue; }
+		bool operator==(std::default_sentinel_t) const { return fhandle.done(); }
+	private:
+		handle fhandle;
+	};
+
+	Generator(Generator&& other) noexcept : fhandle(other.fhandle) { other.fhandle = handle(); }
+	~Generator() { if(fhandle) fhandle.destroy(); }
+
+	iterator begin() {
+		resume(fhandle);
+		return iterator(fhandle);
+	}
+	std::default_sentinel_t end() { return std::default_sentinel; }
+private:
+	explicit Generator(handle h) : fhandle(h) {}
+	Generator(const Generator&) = delete;
+
+	static void resume(handle h) {
+		h.resume();
+		if(h.promise().fexception) std::rethrow_exception(h.promise().fexception);
+	}
+
+	handle fhandle;
+};
+
+/** Parse the tokens of a range, which may produce them lazily (e.g. as they
+ * are read from a socket), yielding the events as they are found.
+ *
+ *	for(const ParseEvent& event : parseEvents(inc, "tool", tokens)) ...
+ *
+ * The range is taken by value; pass a view (e.g. std::views::all(v)) to avoid a copy.
+ */
+template<typename Tokens>
+Generator<ParseEvent> parseEvents(IncrementalParser& parser, string programName, Tokens tokens) {
+	ParseEvent event;
+
+	parser.begin(programName);
+	for(const auto& token : tokens) {
+		parser.feed(token);
+		while(parser.poll(event)) co_yield event;
+	}
+
+	parser.finish();
+	while(parser.poll(event)) co_yield event;
+}
+
+#endif
+
+} //namespace
+
+#endif
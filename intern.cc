@@ -0,0 +1,190 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+#include "intern.h"
+
+namespace vlofgren {
+
+/*
+ *
+ * Class InternedString
+ *
+ *
+ */
+
+const string& InternedString::str() const {
+	static const string empty;
+	return fentry ? fentry->text : empty;
+}
+
+uint32_t InternedString::id() const {
+	return fentry ? fentry->id : InternTable::NO_ID;
+}
+
+/*
+ *
+ * Class InternTable
+ *
+ *
+ */
+
+const InternTable::Id InternTable::NO_ID;
+
+InternTable::InternTable() {}
+
+/* 64-bit FNV-1a, as in EnumMatcher */
+static uint64_t internHash(const char* s, size_t length) {
+	uint64_t h = 14695981039346656037ULL;
+	for(size_t i = 0; i < length; i++) h = (h ^ (unsigned char) s[i]) * 1099511628211ULL;
+	return h;
+}
+
+InternedString InternTable::intern(const char* s, size_t length) {
+	if(!length) return InternedString();
+
+	Key key = { s, length, internHash(s, length), NULL };
+
+	/* The top bits pick the shard, so that they don't correlate with the
+	 * buckets of the shard's index, which use the low bits */
+	Shard& shard = fshards[key.hash >> 60];
+	lock_guard<mutex> lock(shard.lock);
+
+	unordered_set<Key, KeyHash, KeyEqual>::const_iterator i = shard.index.find(key);
+	if(i != shard.index.end()) return InternedString(i->entry);
+
+	lock_guard<mutex> idsLock(fidsLock);
+	if(fids.size() >= NO_ID) throw length_error("InternTable: too many strings");
+
+	/* Constructed from the text, which allocates it exactly; assign() would
+	 * round the capacity up */
+	InternedString::Entry added = { string(s, length), (uint32_t) fids.size() };
+	shard.entries.push_back(std::move(added));
+	InternedString::Entry& entry = shard.entries.back();
+	fids.push_back(&entry);
+
+	/* Point the key at the table's own copy of the text */
+	key.data = entry.text.data();
+	key.entry = &entry;
+	shard.index.insert(key);
+
+	return InternedString(&entry);
+}
+
+InternedString InternTable::intern(const string& s) {
+	return intern(s.data(), s.length());
+}
+
+InternedString InternTable::find(Id id) const {
+	lock_guard<mutex> lock(fidsLock);
+	if(id >= fids.size()) throw out_of_range("InternTable::find()");
+	return InternedString(fids[id]);
+}
+
+size_t InternTable::size() const {
+	lock_guard<mutex> lock(fidsLock);
+	return fids.size();
+}
+
+size_t InternTable::memoryUsage() const {
+	size_t bytes = sizeof(*this);
+
+	for(size_t i = 0; i < SHARDS; i++) {
+		const Shard& shard = fshards[i];
+		lock_guard<mutex> lock(shard.lock);
+
+		/* Each node of the index holds its key and a link, besides the bucket array */
+		bytes += shard.index.bucket_count() * sizeof(void*);
+		bytes += shard.index.size() * (sizeof(Key) + sizeof(void*));
+		bytes += shard.entries.size() * sizeof(InternedString::Entry);
+		for(deque<InternedString::Entry>::const_iterator e = shard.entries.begin(); e != shard.entries.end(); e++) {
+			bytes += MemoryUsage::heap(e->text);
+		}
+	}
+
+	lock_guard<mutex> lock(fidsLock);
+	return bytes + fids.size() * sizeof(const InternedString::Entry*);
+}
+
+InternTable& InternTable::shared() {
+	static InternTable table;
+	return table;
+}
+
+/*
+ *
+ * Class InternedStringParameter
+ *
+ *
+ */
+
+InternedStringParameter::InternedStringParameter(char shortOption, const char *longOption,
+		const char* description) : PODParameter<InternedString>(shortOption, longOption, description),
+		ftable(&InternTable::shared()) {}
+
+InternedStringParameter::~InternedStringParameter() {}
+
+InternedStringParameter& InternedStringParameter::setTable(InternTable& table) {
+	ftable = &table;
+	return *this;
+}
+
+InternTable& InternedStringParameter::table() const {
+	return *ftable;
+}
+
+bool InternedStringParameter::formatArgument(string& out) const {
+	if(!isSet()) return false;
+
+	out.append(value.str());
+	return true;
+}
+
+const char* InternedStringParameter::typeName() const {
+	return "string";
+}
+
+InternedString InternedStringParameter::validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	return ftable->intern(s);
+}
+
+/* ValueCodec can only intern into the shared table, so the text is decoded
+ * as a string and interned into this parameter's table */
+bool InternedStringParameter::restoreValue(const char* data, size_t length) {
+	string restored, restoredDefault;
+	unsigned state = switchState();
+	if(!decodeValues(data, length, state, restored, restoredDefault)) return false;
+
+	value = ftable->intern(restored);
+	if(state == (STATE_SET | STATE_PRESET)) fdefault = ftable->intern(restoredDefault);
+	else if(state == STATE_PRESET) fdefault = value;
+	valueChanged();
+
+	return true;
+}
+
+bool InternedStringParameter::canRestoreValue(const char* data, size_t length, unsigned state) const {
+	string restored, restoredDefault;
+	return decodeValues(data, length, state, restored, restoredDefault);
+}
+
+size_t InternedStringParameter::objectSize() const {
+	return sizeof(*this);
+}
+
+} //namespace
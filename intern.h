@@ -0,0 +1,225 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+#include "getoptpp.h"
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+#ifndef GETOPTPP_INTERN_H
+#define GETOPTPP_INTERN_H
+
+namespace vlofgren {
+
+class InternTable;
+
+/** A string held by an InternTable.
+ *
+ * A table holds each distinct string once, so two InternedStrings of the same
+ * table are equal exactly when they point to the same entry, and comparing
+ * them compares two pointers. (Strings of different tables always compare
+ * unequal, except for the empty string, which no table holds.) Copying one
+ * copies a pointer, and the text stays valid as long as the table.
+ */
+class GETOPTPP_API InternedString {
+public:
+	/** An entry of a table, which is never changed or moved once added */
+	struct Entry {
+		string text;
+		uint32_t id;
+	};
+
+	/** The empty string, which is what every table interns "" as */
+	InternedString() : fentry(NULL) {}
+
+	const string& str() const;
+	const char* c_str() const { return str().c_str(); }
+	size_t length() const { return str().length(); }
+
+	/** The id of the string in its table (see InternTable::find()), or
+	 * InternTable::NO_ID if it isn't held by one */
+	uint32_t id() const;
+
+	bool operator==(const InternedString& other) const { return fentry == other.fentry; }
+	bool operator!=(const InternedString& other) const { return fentry != other.fentry; }
+
+	const Entry* entry() const { return fentry; }
+private:
+	friend class InternTable;
+	InternedString(const Entry* entry) : fentry(entry) {}
+
+	const Entry* fentry;
+};
+
+/** A thread-safe set of strings, each with a stable id and address.
+ *
+ * Lookups are spread over shards by hash, each with a lock of its own, so
+ * threads interning different strings rarely wait for each other. A string
+ * that is already in the table is found without allocating anything. Strings
+ * are never removed; the memory grows with the number of distinct strings.
+ */
+class GETOPTPP_API InternTable {
+public:
+	typedef uint32_t Id;
+
+	static const Id NO_ID = 0xffffffff;
+
+	InternTable();
+
+	/** The string equal to s[0, length), added if it isn't in the table yet.
+	 * The empty string is InternedString(), and isn't added. */
+	InternedString intern(const char* s, size_t length);
+	InternedString intern(const string& s);
+
+	/** The string with the given id. Ids are given out in order, from 0.
+	 *
+	 * @throw out_of_range if there is none
+	 */
+	InternedString find(Id id) const;
+
+	/** Number of strings in the table */
+	size_t size() const;
+
+	/** Bytes used by the table */
+	size_t memoryUsage() const;
+
+	/** A table for the whole program, which InternedStringParameter uses by default */
+	static InternTable& shared();
+private:
+	InternTable(const InternTable&);
+	InternTable& operator=(const InternTable&);
+
+	/** An entry, or the string being looked up */
+	struct Key {
+		const char* data;
+		size_t length;
+		uint64_t hash;
+		const InternedString::Entry* entry;
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& k) const { return k.hash; }
+	};
+
+	struct KeyEqual {
+		bool operator()(const Key& a, const Key& b) const {
+			return a.length == b.length && memcmp(a.data, b.data, a.length) == 0;
+		}
+	};
+
+	enum { SHARDS = 16 };
+
+	struct Shard {
+		mutable mutex lock;
+		unordered_set<Key, KeyHash, KeyEqual> index;
+		deque<InternedString::Entry> entries;
+	};
+
+	Shard fshards[SHARDS];
+
+	/** The entries by id */
+	mutable mutex fidsLock;
+	deque<const InternedString::Entry*> fids;
+};
+
+/** Snapshots save the text. A PODParameter<InternedString>, which has no
+ * table of its own, restores it into InternTable::shared(); an
+ * InternedStringParameter decodes the text and interns it into its table. */
+template<>
+struct ValueCodec<InternedString> {
+	static const bool supported = true;
+
+	static void encode(const InternedString& value, string& out) { out.append(value.str()); }
+
+	/** The text is held by the table */
+	static size_t heapBytes(const InternedString&) { return 0; }
+
+	static bool decode(const char* data, size_t length, InternedString& value) {
+		value = InternTable::shared().intern(data, length);
+		return true;
+	}
+};
+
+/** Like ValueCodec, a PODParameter<InternedString> interns into InternTable::shared() */
+template<>
+struct ValueParser<InternedString> {
+	static const bool supported = true;
+
+	static bool parse(const string& s, InternedString& value, string&) {
+		value = InternTable::shared().intern(s);
+		return true;
+	}
+};
+
+/** Parameter taking a string, which is interned.
+ *
+ * A program that parses many command lines repeating the same few values
+ * (e.g. a dispatcher parsing --queue=... for every job) then holds each
+ * distinct value once, and compares them by pointer:
+ *
+ *	InternTable queues;
+ *	ps.add<InternedStringParameter>('q', "queue", "Queue").setTable(queues);
+ *	...
+ *	if(ps['q'].get<InternedString>() == urgent) ...
+ *
+ * The table is shared by the parsers that use it, which may run on any
+ * number of threads.
+ */
+class GETOPTPP_API InternedStringParameter : public PODParameter<InternedString> {
+public:
+	InternedStringParameter(char shortOption, const char *longOption,
+			const char* description);
+	virtual ~InternedStringParameter();
+
+	/** Intern into table, rather than into InternTable::shared(). The table must
+	 * outlive the parameter's values. */
+	InternedStringParameter& setTable(InternTable& table);
+
+	InternTable& table() const;
+
+	virtual bool formatArgument(string& out) const;
+
+	virtual const char* typeName() const;
+protected:
+	virtual InternedString validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected);
+
+	virtual bool restoreValue(const char* data, size_t length);
+	virtual bool canRestoreValue(const char* data, size_t length, unsigned state) const;
+
+	virtual size_t objectSize() const;
+
+	InternTable* ftable;
+};
+
+} //namespace
+
+namespace std {
+
+/** Hashes the address of the entry, which is as good as hashing the text */
+template<>
+struct hash<vlofgren::InternedString> {
+	size_t operator()(const vlofgren::InternedString& s) const {
+		return hash<const void*>()(s.entry());
+	}
+};
+
+}
+
+#endif
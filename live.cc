@@ -0,0 +1,216 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+#include "live.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace vlofgren {
+
+/*
+ *
+ * Class OptionsSnapshot
+ *
+ *
+ */
+
+string OptionsSnapshot::take(const OptionsParser& parser) {
+	string data;
+	parser.snapshot(data);
+	return data;
+}
+
+OptionsSnapshot::OptionsSnapshot(const OptionsParser& parser, uint64_t generation) :
+	fdata(take(parser)), fview(parser, fdata.data(), fdata.size()),
+	ffiles(parser.getFiles()), fgeneration(generation) {}
+
+bool OptionsSnapshot::isSet(const Parameter& p) const {
+	return fview.switchState(p.index()) != 0;
+}
+
+bool OptionsSnapshot::wasGiven(const Parameter& p) const {
+	return (fview.switchState(p.index()) & Parameter::STATE_SET) != 0;
+}
+
+bool OptionsSnapshot::same(const Parameter& p, const OptionsSnapshot& other) const {
+	if(fview.switchState(p.index()) != other.fview.switchState(p.index())) return false;
+
+	size_t length, otherLength;
+	const char* value = fview.value(p.index(), length);
+	const char* otherValue = other.fview.value(p.index(), otherLength);
+
+	if(!value || !otherValue) return value == otherValue;
+	return length == otherLength && memcmp(value, otherValue, length) == 0;
+}
+
+const vector<string>& OptionsSnapshot::getFiles() const { return ffiles; }
+uint64_t OptionsSnapshot::generation() const { return fgeneration; }
+
+/*
+ *
+ * Class LiveOptions
+ *
+ *
+ */
+
+LiveOptions::ChangeListener::~ChangeListener() {}
+
+const uint64_t LiveOptions::Reader::IDLE;
+
+LiveOptions::Reader::Reader(LiveOptions& live) : flive(live), fgeneration(IDLE) {
+	std::lock_guard<std::mutex> lock(flive.freadersLock);
+	flive.freaders.push_back(this);
+}
+
+LiveOptions::Reader::~Reader() {
+	std::lock_guard<std::mutex> lock(flive.freadersLock);
+	flive.freaders.erase(find(flive.freaders.begin(), flive.freaders.end(), this));
+}
+
+/* The snapshot is loaded after the generation is announced, both sequentially
+ * consistent. A reclaim() that misses the announcement thus ran before it,
+ * after the snapshots it deletes were replaced, so the load sees a newer one.
+ */
+const OptionsSnapshot* LiveOptions::Reader::enter() {
+	fgeneration.store(flive.fgeneration.load());
+	return flive.fcurrent.load();
+}
+
+void LiveOptions::Reader::leave() {
+	fgeneration.store(IDLE, std::memory_order_release);
+}
+
+LiveOptions::LiveOptions(OptionsParser& parser) : fparser(parser),
+	fcurrent(new OptionsSnapshot(parser, 0)), fgeneration(0) {}
+
+LiveOptions::~LiveOptions() {
+	for(size_t i = 0; i < fretired.size(); i++) delete fretired[i];
+	delete fcurrent.load();
+}
+
+const OptionsSnapshot* LiveOptions::current() const {
+	return fcurrent.load(std::memory_order_acquire);
+}
+
+void LiveOptions::onChange(const Parameter& p, ChangeListener& listener) {
+	std::lock_guard<std::mutex> lock(fwriter);
+	flisteners.push_back(make_pair(&p, &listener));
+}
+
+void LiveOptions::reload(int argc, const char* argv[]) {
+	std::lock_guard<std::mutex> lock(fwriter);
+	const OptionsSnapshot* before = fcurrent.load(std::memory_order_relaxed);
+
+	try {
+		fparser.parse(argc, argv);
+	} catch(...) {
+		/* Leave the parser as it was, for the next reload */
+		fparser.restore(before->fdata.data(), before->fdata.size());
+		throw;
+	}
+
+	OptionsSnapshot* after = new OptionsSnapshot(fparser, before->generation() + 1);
+
+	fretired.push_back(before);
+	fcurrent.store(after);
+	fgeneration.store(after->generation());
+
+	for(size_t i = 0; i < flisteners.size(); i++) {
+		const Parameter& p = *flisteners[i].first;
+		if(!after->same(p, *before)) flisteners[i].second->changed(p, *before, *after);
+	}
+}
+
+/* Split a response file into arguments */
+static void splitArguments(const string& text, vector<string>& args) {
+	string::size_type i = 0;
+
+	while(i < text.length()) {
+		char c = text[i];
+
+		if(c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			i++;
+			continue;
+		}
+		if(c == '#') {
+			i = text.find('\n', i);
+			continue;
+		}
+
+		string arg;
+		while(i < text.length()) {
+			c = text[i];
+			if(c == ' ' || c == '\t' || c == '\r' || c == '\n') break;
+
+			if(c == '\'' || c == '"') {
+				string::size_type end = text.find(c, i + 1);
+				if(end == string::npos) throw runtime_error("unterminated quote in response file");
+				arg.append(text, i + 1, end - i - 1);
+				i = end + 1;
+			} else {
+				arg += c;
+				i++;
+			}
+		}
+		args.push_back(arg);
+	}
+}
+
+void LiveOptions::reloadFile(const char* path) {
+	FILE* f = fopen(path, "rb");
+	if(!f) throw runtime_error(string("can not open ") + path);
+
+	string text;
+	char buffer[4096];
+	size_t n;
+	while((n = fread(buffer, 1, sizeof(buffer), f)) > 0) text.append(buffer, n);
+
+	bool failed = ferror(f);
+	fclose(f);
+	if(failed) throw runtime_error(string("can not read ") + path);
+
+	vector<string> args(1, fparser.programName());
+	splitArguments(text, args);
+
+	vector<const char*> argv;
+	for(size_t i = 0; i < args.size(); i++) argv.push_back(args[i].c_str());
+
+	reload(argv.size(), &argv[0]);
+}
+
+void LiveOptions::reclaim() {
+	std::lock_guard<std::mutex> lock(fwriter);
+
+	/* A reader that entered at generation g may be using any snapshot from
+	 * g on, and the retired ones all come before the current one */
+	uint64_t oldest = Reader::IDLE;
+	{
+		std::lock_guard<std::mutex> readersLock(freadersLock);
+		for(size_t i = 0; i < freaders.size(); i++) oldest = min(oldest, freaders[i]->fgeneration.load());
+	}
+
+	size_t kept = 0;
+	for(size_t i = 0; i < fretired.size(); i++) {
+		if(fretired[i]->generation() < oldest) delete fretired[i];
+		else fretired[kept++] = fretired[i];
+	}
+	fretired.resize(kept);
+}
+
+} //namespace
@@ -0,0 +1,201 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "getoptpp.h"
+#include <atomic>
+#include <mutex>
+
+#ifndef GETOPTPP_LIVE_H
+#define GETOPTPP_LIVE_H
+
+namespace vlofgren {
+
+/** Immutable result of a parse, as published by LiveOptions.
+ *
+ * Values are read out of the snapshot's bytes, so a snapshot can be shared
+ * by any number of threads without synchronization.
+ */
+class GETOPTPP_API OptionsSnapshot {
+public:
+	/** Take a snapshot of a parser's state (see OptionsParser::snapshot()) */
+	OptionsSnapshot(const OptionsParser& parser, uint64_t generation);
+
+	/** Test whether the parameter was set or preset */
+	bool isSet(const Parameter& p) const;
+
+	/** Test whether the parameter was given on the command line */
+	bool wasGiven(const Parameter& p) const;
+
+	/** The value of a PODParameter<T>.
+	 *
+	 * @throw runtime_error if the parameter has no value
+	 */
+	template<typename T>
+	T get(const Parameter& p) const;
+
+	/** Test whether a parameter has the same state and value in both snapshots */
+	bool same(const Parameter& p, const OptionsSnapshot& other) const;
+
+	const vector<string>& getFiles() const;
+
+	/** Number of the reload that produced the snapshot (0 for the first) */
+	uint64_t generation() const;
+private:
+	friend class LiveOptions;
+
+	OptionsSnapshot(const OptionsSnapshot&);
+
+	static string take(const OptionsParser& parser);
+
+	string fdata;
+	SnapshotView fview;
+	vector<string> ffiles;
+	uint64_t fgeneration;
+};
+
+/** Options that can be reloaded while the program runs, e.g. on SIGHUP.
+ *
+ * Each reload parses into the parser as usual, takes an OptionsSnapshot of
+ * the result and publishes it with a single atomic store, RCU style. Reading
+ * never blocks or retries, no matter what the reloading thread does.
+ *
+ * Threads read through a Reader of their own, which says which snapshot
+ * generations they may still be using. reclaim() deletes the snapshots that
+ * have been replaced and that no Reader can be using any longer, so it can
+ * be called at any time, e.g. after each reload:
+ *
+ *	LiveOptions::Reader reader(live);	// once per thread
+ *	for(;;) {
+ *		const OptionsSnapshot* options = reader.enter();
+ *		serve(request, *options);
+ *		reader.leave();
+ *	}
+ *
+ * The parser itself belongs to LiveOptions once it has been handed over, as
+ * its parameters are overwritten by each reload: read through snapshots.
+ */
+class GETOPTPP_API LiveOptions {
+public:
+
+	/** Notified of each parameter that changed in a reload */
+	class ChangeListener {
+	public:
+		virtual ~ChangeListener();
+
+		/** Called after the new snapshot has been published */
+		virtual void changed(const Parameter& p, const OptionsSnapshot& before,
+				const OptionsSnapshot& after) = 0;
+	};
+
+	/** A thread reading snapshots. Entering is two atomic stores and two
+	 * loads; it never blocks or retries.
+	 *
+	 * A Reader is used by one thread at a time, and must be destroyed before
+	 * the LiveOptions it reads.
+	 */
+	class GETOPTPP_API Reader {
+	public:
+		Reader(LiveOptions& live);
+		~Reader();
+
+		/** The latest published snapshot, which reclaim() keeps until leave() */
+		const OptionsSnapshot* enter();
+
+		/** Done with the snapshot enter() returned */
+		void leave();
+	private:
+		friend class LiveOptions;
+
+		Reader(const Reader&);
+
+		LiveOptions& flive;
+
+		/** The generation published when the reader entered, or IDLE */
+		std::atomic<uint64_t> fgeneration;
+
+		static const uint64_t IDLE = ~(uint64_t) 0;
+	};
+
+	/** @param parser An already parsed parser, whose state becomes the first snapshot */
+	LiveOptions(OptionsParser& parser);
+
+	/** Every Reader must be gone by then */
+	~LiveOptions();
+
+	/** The latest published snapshot. Outside of a Reader, it is only valid
+	 * until the next reclaim(): use it from the thread that reloads. */
+	const OptionsSnapshot* current() const;
+
+	/** Have listener told about changes to the parameter.
+	 *
+	 * The listener is not owned, and must outlive LiveOptions.
+	 */
+	void onChange(const Parameter& p, ChangeListener& listener);
+
+	/** Parse a new command line, and publish the result if it parses.
+	 *
+	 * @throw Parameter::ParameterRejected if the command line doesn't parse,
+	 * 		in which case the current snapshot stays.
+	 */
+	void reload(int argc, const char* argv[]);
+
+	/** reload() from a response file: the arguments are separated by white space,
+	 * can be quoted with ' or ", and a # where an argument would start comments
+	 * out the rest of the line.
+	 *
+	 * @throw runtime_error if the file can't be read
+	 */
+	void reloadFile(const char* path);
+
+	/** Delete the snapshots that have been replaced, except those a Reader
+	 * that entered before they were replaced may still be using */
+	void reclaim();
+private:
+	LiveOptions(const LiveOptions&);
+
+	OptionsParser& fparser;
+	std::atomic<const OptionsSnapshot*> fcurrent;
+
+	/** The generation of fcurrent, stored after it */
+	std::atomic<uint64_t> fgeneration;
+
+	/** Serializes reloads (and reclaims) */
+	std::mutex fwriter;
+
+	vector<const OptionsSnapshot*> fretired;
+
+	std::mutex freadersLock;
+	vector<Reader*> freaders;
+	vector<pair<const Parameter*, ChangeListener*> > flisteners;
+};
+
+template<typename T>
+T OptionsSnapshot::get(const Parameter& p) const {
+	size_t length;
+	const char* saved = fview.value(p.index(), length);
+
+	T value;
+	if(!saved || !PODParameter<T>::loadValue(saved, length, value)) {
+		throw runtime_error("--" + p.longOption() + " has no value in this snapshot");
+	}
+	return value;
+}
+
+} //namespace
+
+#endif
@@ -26,7 +26,9 @@
 template<typename T>
 T &ParameterSet::add(char shortName, const char* longName, const char* description) {
 	T* p = new T(shortName, longName, description);
+	p->findex = fordered.size();
 	parameters.insert(p);
+	fordered.push_back(p);
 	return *p;
 }
 
@@ -60,82 +62,66 @@ bool CommonParameter<SwitchingBehavior>::isSet() const{
 }
 
 template<typename SwitchingBehavior>
-string CommonParameter<SwitchingBehavior>::usageLine() const {
-	stringstream strstr;
-
-		strstr.width(10);
-		strstr << left<< string("-") + shortOption();
-		strstr.width(20);
-		strstr << left << "--" + longOption();
+void CommonParameter<SwitchingBehavior>::reset() {
+	SwitchingBehavior::reset();
+}
 
-		return strstr.str();
+template<typename SwitchingBehavior>
+unsigned CommonParameter<SwitchingBehavior>::switchState() const {
+	return SwitchingBehavior::state();
 }
 
+template<typename SwitchingBehavior>
+void CommonParameter<SwitchingBehavior>::restoreSwitchState(unsigned state) {
+	SwitchingBehavior::restoreState(state);
+}
 
+template<typename SwitchingBehavior>
+size_t CommonParameter<SwitchingBehavior>::objectSize() const {
+	return sizeof(*this);
+}
 
 template<typename SwitchingBehavior>
-bool CommonParameter<SwitchingBehavior>::receive(ParserState& state) throw(Parameter::ParameterRejected) {
+string CommonParameter<SwitchingBehavior>::usageLine() const {
+	return usageColumns(string("-") + shortOption(), "--" + longOption());
+}
 
-	const string arg = state.get();
 
-	try {
-		if(arg.at(0) != '-') return false;
-
-		if(arg.at(1) == '-') { /* Long form parameter */
-
-			try {
-				unsigned int eq = arg.find_first_of("=");
-
-				if(eq == string::npos) {
-					if(arg.substr(2) != longOption())
-						return false;
-
-					this->receiveSwitch();
-				} else {
-					if(arg.substr(2, eq-2) != longOption())
-						return false;
-
-					this->receiveArgument(arg.substr(eq+1));
-				}
-				return true;
-			} catch(Parameter::ExpectedArgument &ea) {
-				throw ExpectedArgument("--" + longOption() + ": expected an argument");
-			} catch(Parameter::UnexpectedArgument &ua) {
-				throw UnexpectedArgument("--" + longOption() + ": did not expect an argument");
-			} catch(Switchable::SwitchingError &e) {
-				throw ParameterRejected("--" + longOption() + ": parameter already set");
-			} catch(Parameter::ParameterRejected &pr) {
-
-				string what = pr.what();
-				if(what.length())
-					throw Parameter::ParameterRejected("--" + longOption() + ": " + what);
-				throw Parameter::ParameterRejected("--" + longOption() + " (unspecified error)");
-			}
-		}
 
-		try {
-			if(arg.at(1) == shortOption()) {
-				/* Matched argument on the form -f or -fsomething */
-				if(arg.length() == 2) { /* -f */
-					this->receiveSwitch();
-
-					return true;
-				} else { /* -fsomething */
-					this->receiveArgument(arg.substr(2));
-
-					return true;
-				}
-			}
-		} catch(Parameter::ExpectedArgument &ea) {
-			throw ExpectedArgument(string("-") + shortOption() + ": expected an argument");
-		} catch(Parameter::UnexpectedArgument &ua) {
-			throw UnexpectedArgument(string("-") + shortOption() + ": did not expect an argument");
-		} catch(Switchable::SwitchingError &e) {
-			throw ParameterRejected(string("-") + shortOption() + ": parameter already set");
+template<typename SwitchingBehavior>
+bool CommonParameter<SwitchingBehavior>::receive(ParserState& state) GETOPTPP_THROW(Parameter::ParameterRejected) {
+
+	const string& arg = state.get();
+
+	/* The token is compared in place, and never looked at past the option's
+	 * name, since it may be huge and is offered to every parameter in turn */
+	if(arg.length() < 2 || arg[0] != '-') return false;
+
+	if(arg[1] == '-') { /* Long form parameter */
+		const string& name = longOption();
+		if(arg.compare(2, name.length(), name) != 0) return false;
+
+		string::size_type end = 2 + name.length();
+		if(end == arg.length()) {
+			receiveLong(NULL);
+		} else if(arg[end] == '=') {
+			const string argument = arg.substr(end + 1);
+			receiveLong(&argument);
+		} else {
+			return false;
 		}
+		return true;
+	}
 
-	} catch(out_of_range& o) {
-		return false;
+	if(arg[1] == shortOption()) {
+		/* Matched argument on the form -f or -fsomething */
+		if(arg.length() == 2) { /* -f */
+			receiveShort(NULL);
+		} else { /* -fsomething */
+			const string argument = arg.substr(2);
+			receiveShort(&argument);
+		}
+		return true;
 	}
 
 	return false;
@@ -143,6 +129,45 @@ bool CommonParameter<SwitchingBehavior>::receive(ParserState& state) throw(Param
 
 
 
+template<typename SwitchingBehavior>
+bool CommonParameter<SwitchingBehavior>::decodesShortOption() const {
+	return true;
+}
+
+template<typename SwitchingBehavior>
+void CommonParameter<SwitchingBehavior>::receiveShort(const string* argument) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	try {
+		if(argument) this->receiveArgument(*argument);
+		else this->receiveSwitch();
+	} catch(Parameter::ExpectedArgument &ea) {
+		throw ExpectedArgument(string("-") + shortOption() + ": expected an argument");
+	} catch(Parameter::UnexpectedArgument &ua) {
+		throw UnexpectedArgument(string("-") + shortOption() + ": did not expect an argument");
+	} catch(Switchable::SwitchingError &e) {
+		throw AlreadySet(string("-") + shortOption() + ": parameter already set");
+	}
+}
+
+template<typename SwitchingBehavior>
+void CommonParameter<SwitchingBehavior>::receiveLong(const string* argument) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	try {
+		if(argument) this->receiveArgument(*argument);
+		else this->receiveSwitch();
+	} catch(Parameter::ExpectedArgument &ea) {
+		throw ExpectedArgument("--" + longOption() + ": expected an argument");
+	} catch(Parameter::UnexpectedArgument &ua) {
+		throw UnexpectedArgument("--" + longOption() + ": did not expect an argument");
+	} catch(Switchable::SwitchingError &e) {
+		throw AlreadySet("--" + longOption() + ": parameter already set");
+	} catch(Parameter::ParameterRejected &pr) {
+		string what = pr.what();
+		if(what.length())
+			pr.rethrow("--" + longOption() + ": " + what);
+		pr.rethrow("--" + longOption() + " (unspecified error)");
+	}
+}
+
+
 /*
  * PODParameter stuff
  *
@@ -163,6 +188,22 @@ template<typename T>
 void PODParameter<T>::setDefault(T value) {
 	PresettableUniquelySwitchable::preset();
 	this->value = value;
+	fdefault = value;
+	valueChanged();
+}
+
+template<typename T>
+bool PODParameter<T>::hasDefault() const {
+	return presetByProgram();
+}
+
+template<typename T>
+void PODParameter<T>::reset() {
+	CommonParameter<PresettableUniquelySwitchable>::reset();
+	if(isSet()) {
+		value = fdefault;
+		valueChanged();
+	}
 }
 
 template<typename T>
@@ -178,25 +219,302 @@ T PODParameter<T>::getValue() const {
 
 template<typename T>
 string PODParameter<T>::usageLine() const {
-	stringstream strstr;
-
-	strstr.width(10);
-	strstr << left<< string("-") + shortOption() +"arg";
-	strstr.width(20);
-	strstr << left << "--" + longOption() + "=arg";
+	return usageColumns(string("-") + shortOption() + "arg", "--" + longOption() + "=arg");
+}
 
-	return strstr.str();
+template<typename T>
+bool PODParameter<T>::takesArgument() const {
+	return true;
 }
 
 template<typename T>
-void PODParameter<T>::receiveSwitch() throw (Parameter::ParameterRejected) {
+void PODParameter<T>::receiveSwitch() GETOPTPP_THROW(Parameter::ParameterRejected) {
 	throw Parameter::ExpectedArgument();
 }
 
+/* The value is saved as a length-prefixed record, followed by another
+ * one with the default if the command line overrode it.
+ */
 template<typename T>
-void PODParameter<T>::receiveArgument(const string &argument) throw(Parameter::ParameterRejected) {
+bool PODParameter<T>::saveValue(string& out) const {
+	if(!isSet()) return false;
+
+	if(!ValueCodec<T>::supported) {
+		throw logic_error("--" + longOption() + ": values of this type can not be saved");
+	}
+
+	const T* values[] = { &value, &fdefault };
+	int count = (switchState() == (STATE_SET | STATE_PRESET)) ? 2 : 1;
+
+	for(int i = 0; i < count; i++) {
+		size_t at = out.size();
+		out.append(sizeof(uint32_t), '\0');
+		ValueCodec<T>::encode(*values[i], out);
+
+		uint32_t length = out.size() - at - sizeof(uint32_t);
+		memcpy(&out[at], &length, sizeof(length));
+	}
+	return true;
+}
+
+template<typename T>
+template<typename V>
+bool PODParameter<T>::decodeValues(const char* data, size_t length, unsigned state, V& value, V& fallback) {
+	V* values[] = { &value, &fallback };
+	int count = (state == (STATE_SET | STATE_PRESET)) ? 2 : 1;
+
+	for(int i = 0; i < count; i++) {
+		uint32_t n;
+		if(length < sizeof(n)) return false;
+		memcpy(&n, data, sizeof(n));
+		data += sizeof(n);
+		length -= sizeof(n);
+
+		if(n > length || !ValueCodec<V>::decode(data, n, *values[i])) return false;
+		data += n;
+		length -= n;
+	}
+
+	return length == 0;
+}
+
+/* Decoded into temporaries, so that a malformed record changes nothing */
+template<typename T>
+bool PODParameter<T>::restoreValue(const char* data, size_t length) {
+	T restored, restoredDefault;
+	unsigned state = switchState();
+	if(!decodeValues(data, length, state, restored, restoredDefault)) return false;
+
+	value = std::move(restored);
+	if(state == (STATE_SET | STATE_PRESET)) fdefault = std::move(restoredDefault);
+	else if(state == STATE_PRESET) fdefault = value;
+	valueChanged();
+
+	return true;
+}
+
+template<typename T>
+bool PODParameter<T>::canRestoreValue(const char* data, size_t length, unsigned state) const {
+	T restored, restoredDefault;
+	return decodeValues(data, length, state, restored, restoredDefault);
+}
+
+template<typename T>
+size_t PODParameter<T>::objectSize() const {
+	return sizeof(*this);
+}
+
+template<typename T>
+size_t PODParameter<T>::valueMemory() const {
+	return ValueCodec<T>::heapBytes(value) + ValueCodec<T>::heapBytes(fdefault);
+}
+
+template<typename T>
+bool PODParameter<T>::formatArgument(string&) const {
+	return false;
+}
+
+template<typename T>
+const char* PODParameter<T>::typeName() const {
+	return "value";
+}
+
+template<typename T>
+void PODParameter<T>::valueChanged() {}
+
+template<typename T>
+bool PODParameter<T>::loadValue(const char* saved, size_t length, T& value) {
+	uint32_t n;
+	if(length < sizeof(n)) return false;
+	memcpy(&n, saved, sizeof(n));
+
+	return n <= length - sizeof(n) && ValueCodec<T>::decode(saved + sizeof(n), n, value);
+}
+
+template<typename T>
+T PODParameter<T>::validate(const string &s) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	/* Enumerations are validated by EnumParameter, or by a specialization of
+	 * validate() as in test.cc; anything else needs a ValueParser */
+	static_assert(ValueParser<T>::supported || std::is_enum<T>::value,
+			"PODParameter<T>: no ValueParser<T>, specialize ValueParser or validate() for T");
+	if(!ValueParser<T>::supported) throw ParameterRejected("no validation function for this type");
+
+	T value;
+	string error;
+	if(!ValueParser<T>::parse(s, value, error)) throw ParameterRejected(error);
+	return value;
+}
+
+template<typename T>
+bool PODParameter<T>::tryValidate(const string &s, T& value, string& error) {
+	if(ValueParser<T>::supported && validatesAs<PODParameter<T> >()) return ValueParser<T>::parse(s, value, error);
+	return catchValidate(s, value, error);
+}
+
+template<typename T>
+bool PODParameter<T>::catchValidate(const string &s, T& value, string& error) {
+	try {
+		value = this->validate(s);
+		return true;
+	} catch(Parameter::ExpectedArgument &e) {
+		throw;
+	} catch(Parameter::UnexpectedArgument &e) {
+		throw;
+	} catch(Parameter::AlreadySet &e) {
+		throw;
+	} catch(Parameter::ParameterRejected &e) {
+		error = e.what();
+		return false;
+	}
+}
+
+template<typename T>
+void PODParameter<T>::receiveArgument(const string &argument) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	/* Only an argument that passes validation sets the parameter, but one
+	 * given twice is an error whatever it is */
+	if(switchState() & STATE_SET) throw Switchable::SwitchingError();
+
+	DeferredValidation* deferred = isExpensive() ? DeferredValidation::active() : NULL;
+	if(deferred) {
+		/* Set now, so that it is found given twice, and unset by reject().
+		 * The job is taken set, as a replayed one is applied by add(). */
+		ValidationJob* job = new ValidationJob(*this, argument);
+		set();
+		deferred->add(job);
+		return;
+	}
+
+	/* A parse that collects its errors is told about a rejected argument
+	 * without an exception */
+	T result;
+	RejectedArgument* rejection = RejectedArgument::active();
+	if(!rejection) {
+		result = this->validate(argument);
+	} else {
+		string error;
+		if(!tryValidate(argument, result, error)) {
+			rejection->reject(error);
+			return;
+		}
+	}
+
 	set();
-	value = this->validate(argument);
+	value = std::move(result);
+	valueChanged();
+}
+
+template<typename T>
+PODParameter<T>::ValidationJob::ValidationJob(PODParameter& parameter, const string& argument) :
+	DeferredValidation::Job(parameter), fparameter(parameter), fargument(argument), fresult(),
+	fstate(parameter.switchState()) {}
+
+template<typename T>
+void PODParameter<T>::ValidationJob::run() {
+	fresult = fparameter.validate(fargument);
+}
+
+template<typename T>
+void PODParameter<T>::ValidationJob::apply() {
+	/* Copied, as a replayed parse applies the result again */
+	fparameter.value = fresult;
+	fparameter.valueChanged();
+}
+
+template<typename T>
+void PODParameter<T>::ValidationJob::reject() {
+	fparameter.restoreSwitchState(fstate);
+}
+
+/*
+ *
+ * Class EnumParameter implementation
+ *
+ *
+ */
+
+template<typename E>
+EnumParameter<E>::EnumParameter(char shortOption, const char *longOption,
+		const char* description) : PODParameter<E>(shortOption, longOption, description),
+		fvalues(NULL), fcount(0) {}
+
+template<typename E>
+EnumParameter<E>::~EnumParameter() {}
+
+template<typename E>
+EnumParameter<E>& EnumParameter<E>::setValues(const Value* values, size_t count, bool ignoreCase) {
+	vector<const char*> names(count);
+	for(size_t i = 0; i < count; i++) names[i] = values[i].name;
+
+	fmatcher.build(names, ignoreCase);
+	fvalues = values;
+	fcount = count;
+
+	return *this;
+}
+
+template<typename E>
+template<size_t N>
+EnumParameter<E>& EnumParameter<E>::setValues(const Value (&values)[N], bool ignoreCase) {
+	return setValues(values, N, ignoreCase);
+}
+
+template<typename E>
+const char* EnumParameter<E>::nameOf(E value) const {
+	for(size_t i = 0; i < fcount; i++) {
+		if(fvalues[i].value == value) return fvalues[i].name;
+	}
+	return NULL;
+}
+
+template<typename E>
+bool EnumParameter<E>::formatArgument(string& out) const {
+	const char* name = this->isSet() ? nameOf(this->value) : NULL;
+	if(name) out += name;
+	return name != NULL;
+}
+
+template<typename E>
+const char* EnumParameter<E>::typeName() const {
+	return "enum";
+}
+
+template<typename E>
+string EnumParameter<E>::usageLine() const {
+	string values;
+	for(size_t i = 0; i < fcount; i++) {
+		values += i ? "|" : "{";
+		values += fvalues[i].name;
+	}
+	values += fcount ? "}" : "{}";
+
+	return this->usageColumns(string("-") + this->shortOption() + "arg", "--" + this->longOption() + "=" + values);
+}
+
+template<typename E>
+size_t EnumParameter<E>::objectSize() const {
+	return sizeof(*this) + fmatcher.memoryUsage();
+}
+
+template<typename E>
+E EnumParameter<E>::validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	long i = fmatcher.find(s.data(), s.length());
+	if(i < 0) throw Parameter::ParameterRejected("Invalid argument \"" + s + "\"");
+
+	return fvalues[i].value;
+}
+
+template<typename E>
+bool EnumParameter<E>::tryValidate(const string& s, E& value, string& error) {
+	if(!this->template validatesAs<EnumParameter<E> >()) return this->catchValidate(s, value, error);
+
+	long i = fmatcher.find(s.data(), s.length());
+	if(i < 0) {
+		error = "Invalid argument \"" + s + "\"";
+		return false;
+	}
+
+	value = fvalues[i].value;
+	return true;
 }
 
 
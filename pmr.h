@@ -0,0 +1,43 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "getoptpp.h"
+#include <memory_resource>
+
+#ifndef GETOPTPP_PMR_H
+#define GETOPTPP_PMR_H
+
+/* MemoryResource over std::pmr, which needs C++17 */
+
+namespace vlofgren {
+
+/** A std::pmr::memory_resource, e.g. a std::pmr::monotonic_buffer_resource,
+ * as a MemoryResource */
+class GETOPTPP_API PmrResource : public MemoryResource {
+public:
+	PmrResource(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : fresource(resource) {}
+
+	virtual void* allocate(size_t bytes, size_t alignment) { return fresource->allocate(bytes, alignment); }
+	virtual void deallocate(void* p, size_t bytes, size_t alignment) { fresource->deallocate(p, bytes, alignment); }
+private:
+	std::pmr::memory_resource* fresource;
+};
+
+} //namespace
+
+#endif
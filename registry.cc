@@ -0,0 +1,86 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include <algorithm>
+#include <atomic>
+
+#include "registry.h"
+#include "intern.h"
+
+namespace vlofgren {
+
+#if !defined(__ELF__)
+
+static const OptionRegistrar* registrars = NULL;
+static vector<OptionDescriptor> registered;
+
+OptionRegistrar::OptionRegistrar(const OptionDescriptor& descriptor) : descriptor(descriptor), next(registrars) {
+	registrars = this;
+}
+
+static const vector<OptionDescriptor>& registeredOptions() {
+	if(registered.empty()) {
+		for(const OptionRegistrar* r = registrars; r; r = r->next) registered.push_back(r->descriptor);
+		std::reverse(registered.begin(), registered.end());
+	}
+	return registered;
+}
+
+const OptionDescriptor* registeredOptionsBegin() {
+	return registeredOptions().data();
+}
+
+const OptionDescriptor* registeredOptionsEnd() {
+	return registeredOptions().data() + registeredOptions().size();
+}
+
+#endif
+
+const char* registeredString(const string& s) {
+	return InternTable::shared().intern(s).c_str();
+}
+
+/*
+ *
+ * Class OptionsParser
+ *
+ *
+ */
+
+/* The parser writing the registered variables */
+static std::atomic<const OptionsParser*> registeredParser(NULL);
+
+void OptionsParser::addRegisteredOptions(const OptionDescriptor* begin, const OptionDescriptor* end) {
+	if(fregistered) return;
+
+	const OptionsParser* none = NULL;
+	if(!registeredParser.compare_exchange_strong(none, this)) {
+		throw logic_error("addRegisteredOptions(): the registered options belong to another parser");
+	}
+	fregistered = true;
+
+	for(const OptionDescriptor* d = begin; d != end; d++) {
+		d->bind(parameters, *d);
+	}
+}
+
+void OptionsParser::releaseRegisteredOptions() {
+	if(fregistered) registeredParser = NULL;
+}
+
+} //namespace
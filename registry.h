@@ -0,0 +1,182 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "getoptpp.h"
+
+#ifndef GETOPTPP_REGISTRY_H
+#define GETOPTPP_REGISTRY_H
+
+namespace vlofgren {
+
+/** An option registered with GETOPTPP_OPTION() or GETOPTPP_SWITCH().
+ *
+ * Descriptors are constant-initialized, and placed in a linker section of their
+ * own, so registering an option runs no code at startup at all; the linker
+ * gathers the descriptors of every object file into one array, which
+ * OptionsParser::addRegisteredOptions() walks when (and if) it is called.
+ */
+struct OptionDescriptor {
+	char shortOption;
+	const char* longOption;
+	const char* description;
+
+	/** The variable the option is stored in */
+	void* storage;
+
+	/** Add a parameter for the option to ps, bound to storage */
+	Parameter& (*bind)(ParameterSet& ps, const OptionDescriptor& descriptor);
+};
+
+/** The type of the variable a registered option of type T is stored in:
+ * T itself, except for strings, which are pointed to as const char* so that
+ * no variable needs a constructor. The text is interned into
+ * InternTable::shared(), so the pointer stays valid after the parameter's
+ * value changes, and after the parser is gone.
+ */
+template<typename T>
+struct RegisteredStorage {
+	typedef T type;
+
+	static void store(const T& value, type* storage) { *storage = value; }
+	static T load(const type* storage) { return *storage; }
+};
+
+/** A copy of s that lives as long as the program, held by InternTable::shared() */
+GETOPTPP_API const char* registeredString(const string& s);
+
+template<>
+struct RegisteredStorage<string> {
+	typedef const char* type;
+
+	static void store(const string& value, type* storage) { *storage = registeredString(value); }
+	static string load(const type* storage) { return *storage ? *storage : ""; }
+};
+
+/** A parameter that mirrors its value into a variable registered with GETOPTPP_OPTION() */
+template<typename P>
+class GETOPTPP_API RegisteredParameter : public P {
+public:
+	typedef typename RegisteredStorage<typename P::value_type>::type storage_type;
+
+	RegisteredParameter(char shortOption, const char *longOption, const char* description) :
+		P(shortOption, longOption, description), fstorage(NULL) {}
+
+	/** Take the variable's current value as the default, and keep the variable up to date */
+	void bind(storage_type* storage) {
+		this->setDefault(RegisteredStorage<typename P::value_type>::load(storage));
+		fstorage = storage;
+	}
+
+protected:
+	/** Keep the variable up to date, however the value changed (including
+	 * by a deferred validation, long after the argument was received) */
+	virtual void valueChanged() {
+		P::valueChanged();
+		if(fstorage && this->isSet()) RegisteredStorage<typename P::value_type>::store(this->value, fstorage);
+	}
+
+	storage_type* fstorage;
+};
+
+/** A switch that mirrors its state into a bool registered with GETOPTPP_SWITCH() */
+template<>
+class RegisteredParameter<SwitchParameter> : public SwitchParameter {
+public:
+	typedef bool storage_type;
+
+	RegisteredParameter(char shortOption, const char *longOption, const char* description) :
+		SwitchParameter(shortOption, longOption, description), fstorage(NULL) {}
+
+	void bind(storage_type* storage) { fstorage = storage; }
+
+	virtual void reset() {
+		SwitchParameter::reset();
+		if(fstorage) *fstorage = false;
+	}
+protected:
+	virtual void receiveSwitch() GETOPTPP_THROW(Parameter::ParameterRejected) {
+		SwitchParameter::receiveSwitch();
+		if(fstorage) *fstorage = true;
+	}
+
+	virtual void restoreSwitchState(unsigned state) {
+		SwitchParameter::restoreSwitchState(state);
+		if(fstorage) *fstorage = isSet();
+	}
+
+	storage_type* fstorage;
+};
+
+template<typename P>
+Parameter& bindRegistered(ParameterSet& ps, const OptionDescriptor& d) {
+	RegisteredParameter<P>& p = ps.add<RegisteredParameter<P> >(d.shortOption, d.longOption, d.description);
+	p.bind(static_cast<typename RegisteredParameter<P>::storage_type*>(d.storage));
+	return p;
+}
+
+#if !defined(__ELF__)
+/** Where there are no linker sections to gather descriptors in, they are
+ * linked into a list by static constructors instead. */
+class GETOPTPP_API OptionRegistrar {
+public:
+	OptionRegistrar(const OptionDescriptor& descriptor);
+
+	const OptionDescriptor& descriptor;
+	const OptionRegistrar* next;
+};
+#endif
+
+} //namespace
+
+#define GETOPTPP_CONCAT_(a, b) a##b
+#define GETOPTPP_CONCAT(a, b) GETOPTPP_CONCAT_(a, b)
+
+#if defined(__ELF__)
+#define GETOPTPP_REGISTER_(type, variable, shortOption, longOption, description) \
+	__attribute__((section("getoptpp_options"), used, aligned(sizeof(void*)))) \
+	extern const ::vlofgren::OptionDescriptor GETOPTPP_CONCAT(getoptpp_option_, variable) = \
+		{ shortOption, longOption, description, &variable, &::vlofgren::bindRegistered<type> };
+#else
+#define GETOPTPP_REGISTER_(type, variable, shortOption, longOption, description) \
+	static const ::vlofgren::OptionDescriptor GETOPTPP_CONCAT(getoptpp_option_, variable) = \
+		{ shortOption, longOption, description, &variable, &::vlofgren::bindRegistered<type> }; \
+	static const ::vlofgren::OptionRegistrar GETOPTPP_CONCAT(getoptpp_registrar_, variable) \
+		(GETOPTPP_CONCAT(getoptpp_option_, variable));
+#endif
+
+/** Define a global variable holding an option, from any file of the program:
+ *
+ *	GETOPTPP_OPTION(IntParameter, threads, 't', "threads", 4, "Number of worker threads");
+ *
+ * defines int threads = 4, which holds the value of -t/--threads once a parser
+ * that called OptionsParser::addRegisteredOptions() has parsed the command line.
+ * String options are stored as const char* (see RegisteredStorage). Declare the
+ * variable extern as usual to use it from other files.
+ *
+ * Must be used at namespace scope, outside of any namespace but the global one.
+ */
+#define GETOPTPP_OPTION(type, variable, shortOption, longOption, defaultValue, description) \
+	::vlofgren::RegisteredParameter<type>::storage_type variable = defaultValue; \
+	GETOPTPP_REGISTER_(type, variable, shortOption, longOption, description)
+
+/** Define a global bool that is set by a switch, like GETOPTPP_OPTION() */
+#define GETOPTPP_SWITCH(variable, shortOption, longOption, description) \
+	bool variable = false; \
+	GETOPTPP_REGISTER_(::vlofgren::SwitchParameter, variable, shortOption, longOption, description)
+
+#endif
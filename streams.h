@@ -0,0 +1,46 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "getoptpp.h"
+#include <iostream>
+#include <sstream>
+
+#ifndef GETOPTPP_STREAMS_H
+#define GETOPTPP_STREAMS_H
+
+namespace vlofgren {
+
+/** Writes to an ostream:
+ *
+ *	OStreamSink out(cout);
+ *	optp.usage(out);
+ */
+class GETOPTPP_API OStreamSink : public OutputSink {
+public:
+	OStreamSink(ostream& stream) : fstream(stream) {}
+
+	virtual void write(const char* data, size_t length) {
+		fstream.write(data, length);
+	}
+private:
+	ostream& fstream;
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,216 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+
+/*
+ * Adversarial input stress test
+ *
+ * Parses command lines built to provoke superlinear behaviour: huge tokens,
+ * tokens made of '=', long runs of '-' tokens and long names that almost
+ * match, with many parameters. Each case is run at 1, 2, 4 and 8 times its
+ * base size, and fails if the time or the heap allocations of the parse grow
+ * faster than the input (with some margin for timing noise). Cases that only
+ * add parameters must not grow at all: the time per token stays flat.
+ *
+ *	stress [scale]	multiplies the base sizes by scale
+ *
+ * Exits with EXIT_FAILURE if any case failed.
+ */
+
+#include "getoptpp.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace vlofgren;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+static void* allocate(size_t size) {
+	allocations++;
+	allocatedBytes += size;
+	if(void* p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+/* Growth allowed from 1x to 8x the size, per unit of input growth. Timing is
+ * noisy, and the larger sizes no longer fit in the caches, but quadratic
+ * behaviour would take it to 64 */
+static const double timeLimit = 3;
+static const double allocationLimit = 1.5;
+
+static long scale = 1;
+
+struct Measurement {
+	double ms;
+	size_t allocations;
+	size_t bytes;
+};
+
+/** A parser with the given number of parameters, named so that they share a long prefix */
+static void addParameters(OptionsParser& optp, long count) {
+	ParameterSet& ps = optp.getParameters();
+	ps.add<SwitchParameter>('v', "verbose", "Verbose");
+	ps.add<StringParameter>('b', "blob", "Blob");
+
+	static vector<string> names;
+	while((long) names.size() < count) {
+		char name[64];
+		snprintf(name, sizeof(name), "option-with-a-rather-long-name-%06ld", (long) names.size());
+		names.push_back(name);
+	}
+	for(long i = 0; i < count; i++) ps.add<IntParameter>(0, names[i].c_str(), "Padding");
+}
+
+/** Build the arguments for size factor k */
+typedef void (*Generator)(long k, vector<string>& tokens, long& parameters);
+
+static Measurement measure(Generator generate, long k) {
+	vector<string> tokens;
+	long parameters = 64;
+	generate(k, tokens, parameters);
+
+	vector<const char*> argv(1, "stress");
+	for(size_t i = 0; i < tokens.size(); i++) argv.push_back(tokens[i].c_str());
+
+	Measurement best = { 1e100, 0, 0 };
+	for(int run = 0; run < 3; run++) {
+		OptionsParser optp("stress");
+		addParameters(optp, parameters);
+		/* Room for an error per token, so that every one of them is recorded */
+		ParseErrors errors(tokens.size() + 1);
+
+		size_t startAllocations = allocations, startBytes = allocatedBytes;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		optp.parse(argv.size(), &argv[0], errors);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+		if(ms < best.ms) best.ms = ms;
+		best.allocations = allocations - startAllocations;
+		best.bytes = allocatedBytes - startBytes;
+	}
+	return best;
+}
+
+/* A multi-megabyte value of a known option */
+static void hugeValue(long k, vector<string>& tokens, long& parameters) {
+	tokens.push_back("--blob=" + string(k * scale << 20, 'x'));
+}
+
+/* A multi-megabyte option that isn't known, but starts like every one that is */
+static void hugeNearMiss(long k, vector<string>& tokens, long& parameters) {
+	tokens.push_back("--option-with-a-rather-long-name-" + string(k * scale << 20, '0') + "=1");
+}
+
+/* Values and names made of '=' */
+static void equalsSigns(long k, vector<string>& tokens, long& parameters) {
+	tokens.push_back("--blob=" + string(k * scale << 20, '='));
+	tokens.push_back("--" + string(k * scale << 20, '='));
+}
+
+/* Long runs of '-' tokens, as options and as files */
+static void dashes(long k, vector<string>& tokens, long& parameters) {
+	tokens.assign(k * scale * 250000, "-v");
+	tokens.push_back("--");
+	tokens.insert(tokens.end(), k * scale * 250000, "-");
+}
+
+/* Many long options that each miss by their last character */
+static void nearMissNames(long k, vector<string>& tokens, long& parameters) {
+	parameters = 1024;
+	tokens.push_back("--verbose");
+	for(long i = 0; i < k * scale * 2000; i++) tokens.push_back("--option-with-a-rather-long-name-00000x");
+}
+
+/* More parameters and longer tokens at once, which is quadratic if every
+ * parameter looks at the whole token */
+static void parametersAndLength(long k, vector<string>& tokens, long& parameters) {
+	parameters = k * 128;
+	tokens.push_back("--blob=" + string(k * scale << 18, 'x'));
+	tokens.push_back("--verbose" + string(k * scale << 18, 'x'));
+	tokens.push_back("--option-with-a-rather-long-name-" + string(k * scale << 18, '0'));
+}
+
+/* The same unknown options against more and more parameters, which must not
+ * cost more per token: only parameters the indexes can't decode are asked */
+static void nearMissParameters(long k, vector<string>& tokens, long& parameters) {
+	parameters = k * 512;
+	for(long i = 0; i < scale * 20000; i++) tokens.push_back("--option-with-a-rather-long-name-00000x");
+}
+
+/** Run a case at each size, allowing its measurements to grow inputGrowth
+ * times (with margin) from the smallest size to the largest */
+static bool check(const char* name, Generator generate, double inputGrowth = 8) {
+	/* Largest first, so that the heap has grown to its size before the others
+	 * are timed, and none of them pays for fresh pages */
+	Measurement m[4];
+	for(int i = 3; i >= 0; i--) m[i] = measure(generate, 1L << i);
+
+	double timeGrowth = m[3].ms / (m[0].ms > 0.01 ? m[0].ms : 0.01);
+	double allocationGrowth = (double) m[3].allocations / (m[0].allocations ? m[0].allocations : 1);
+	double byteGrowth = (double) m[3].bytes / (m[0].bytes ? m[0].bytes : 1);
+	bool ok = timeGrowth <= inputGrowth * timeLimit && allocationGrowth <= inputGrowth * allocationLimit
+		&& byteGrowth <= inputGrowth * allocationLimit;
+
+	printf("%-22s", name);
+	for(int i = 0; i < 4; i++) printf(" %9.2f ms %7zu allocs", m[i].ms, m[i].allocations);
+	printf("   x%.1f time x%.1f allocs x%.1f bytes  %s\n", timeGrowth, allocationGrowth, byteGrowth, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+int main(int argc, const char* argv[]) {
+	scale = argc > 1 ? atol(argv[1]) : 1;
+	if(scale < 1) scale = 1;
+
+#if defined(__GLIBC__)
+	/* Keep huge blocks in the heap, rather than mapping and unmapping them
+	 * (and faulting their pages in) anew for every parse */
+	mallopt(M_MMAP_THRESHOLD, 256 << 20);
+	mallopt(M_TRIM_THRESHOLD, 1 << 30);
+#endif
+
+	bool ok = true;
+	ok &= check("huge value", hugeValue);
+	ok &= check("huge near miss", hugeNearMiss);
+	ok &= check("equals signs", equalsSigns);
+	ok &= check("dashes", dashes);
+	ok &= check("near-miss names", nearMissNames);
+	ok &= check("parameters x length", parametersAndLength);
+	ok &= check("near-miss parameters", nearMissParameters, 1);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
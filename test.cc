@@ -17,6 +17,8 @@
 
 
 #include "getoptpp.h"
+#include "validators.h"
+#include "registry.h"
 #include <cstdlib>
 #include <cctype>
 #include <iostream>
@@ -44,7 +46,7 @@ public:
 		StringParameter(shortName, longName, description) {}
 	virtual ~AlphabeticParameter() {}
 
-	void receiveSwitch() throw(Parameter::ParameterRejected) {
+	void receiveSwitch() GETOPTPP_THROW(Parameter::ParameterRejected) {
 		throw Parameter::ParameterRejected();
 	}
 
@@ -52,7 +54,7 @@ public:
 	/* isalpha may be a macro */
 	static bool isNotAlpha(char c) { return !isalpha(c); }
 
-	virtual string validate(const string& arg) throw(Parameter::ParameterRejected) {
+	virtual string validate(const string& arg) GETOPTPP_THROW(Parameter::ParameterRejected) {
 		int nonalpha = count_if(arg.begin(), arg.end(), isNotAlpha);
 
 
@@ -73,7 +75,7 @@ enum RockPaperScissor { ROCK, PAPER, SCISSOR } ;
 namespace vlofgren {
 	// needs to live in the vlofgren namespace for whatever reason
 	template<> enum RockPaperScissor
-	PODParameter<enum RockPaperScissor>::validate(const string &s) throw(Parameter::ParameterRejected)
+	PODParameter<enum RockPaperScissor>::validate(const string &s) GETOPTPP_THROW(Parameter::ParameterRejected)
 	{
 		if(s == "rock")
 			return ROCK;
@@ -89,6 +91,27 @@ namespace vlofgren {
 }
 typedef PODParameter<enum RockPaperScissor> RockPaperScissorParameter;
 
+/*
+ *
+ * For enums there is also EnumParameter, which only needs a table of names
+ *
+ */
+
+enum Shape { CIRCLE, SQUARE, TRIANGLE };
+
+static const EnumParameter<Shape>::Value shapes[] = {
+	{ "circle", CIRCLE }, { "square", SQUARE }, { "triangle", TRIANGLE }
+};
+
+/*
+ *
+ * Options can also be defined as global variables anywhere in the program,
+ * and are picked up by OptionsParser::addRegisteredOptions()
+ *
+ */
+
+GETOPTPP_OPTION(LongParameter, repeat, 'n', "repeat", 1, "Number of times to do it (registered option)");
+
 
 /*
  *
@@ -117,7 +140,10 @@ int main(int argc, const char* argv[]) {
 
 	ps.add<AlphabeticParameter>('a', "alpha", "Custom parameter that requires a string of letters");
 	ps.add<RockPaperScissorParameter>('r', "rps", "Takes the values rock, paper or scissor");
+	ps.add<ValidatedStringParameter>('x', "hex", "Takes a hexadecimal number, e.g. 0x1f").validator().pattern("0x[0-9a-fA-F]{1,16}");
+	ps.add<EnumParameter<Shape> >('s', "shape", "Takes a shape (in any case)").setValues(shapes, true);
 	ps.add<SwitchParameter>('h', "help", "Display help screen");
+	optp.addRegisteredOptions();
 
 
 	// Register the parameters with the parser
@@ -168,6 +194,17 @@ int main(int argc, const char* argv[]) {
 			cout << "not set" << endl;
 		}
 
+		cout << "hex: " << ps["hex"].get<string>() << endl;
+
+		cout << "shape: ";
+		if(ps["shape"].isSet()) {
+			cout << ps["shape"].get<Shape>() << endl;
+		} else {
+			cout << "not set" << endl;
+		}
+
+		cout << "repeat: " << repeat << endl;
+
 	} catch(Parameter::ParameterRejected &p){
 		// This will happen if the user has fed some malformed parameter to the program
 		cerr << p.what() << endl;
@@ -0,0 +1,430 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+/* Value types with units: sizes, durations and sets of ranges */
+
+#include "units.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace vlofgren {
+
+struct Unit {
+	const char* name;
+	uint64_t scale;
+};
+
+static const Unit sizeUnits[] = {
+	{ "b", 1ULL },
+	{ "k", 1ULL << 10 }, { "kb", 1ULL << 10 }, { "kib", 1ULL << 10 },
+	{ "m", 1ULL << 20 }, { "mb", 1ULL << 20 }, { "mib", 1ULL << 20 },
+	{ "g", 1ULL << 30 }, { "gb", 1ULL << 30 }, { "gib", 1ULL << 30 },
+	{ "t", 1ULL << 40 }, { "tb", 1ULL << 40 }, { "tib", 1ULL << 40 },
+	{ "p", 1ULL << 50 }, { "pb", 1ULL << 50 }, { "pib", 1ULL << 50 },
+	{ "e", 1ULL << 60 }, { "eb", 1ULL << 60 }, { "eib", 1ULL << 60 }
+};
+
+/* Largest first, for formatting */
+static const Unit durationUnits[] = {
+	{ "d", 86400000000000ULL }, { "h", 3600000000000ULL }, { "m", 60000000000ULL },
+	{ "s", 1000000000ULL }, { "ms", 1000000ULL }, { "us", 1000ULL }, { "ns", 1ULL }
+};
+
+static const uint64_t powersOfTen[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static inline char lower(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/* a * b into result, or true if it overflows */
+static inline bool mulOverflows(uint64_t a, uint64_t b, uint64_t& result) {
+#if defined(__GNUC__)
+	return __builtin_mul_overflow(a, b, &result);
+#else
+	if(b && a > UINT64_MAX / b) return true;
+	result = a * b;
+	return false;
+#endif
+}
+
+/* a + b into result, or true if it overflows */
+static inline bool addOverflows(uint64_t a, uint64_t b, uint64_t& result) {
+#if defined(__GNUC__)
+	return __builtin_add_overflow(a, b, &result);
+#else
+	result = a + b;
+	return result < a;
+#endif
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+	while(b) {
+		uint64_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+/* Parse a number with an optional fraction and unit, starting at s[pos], in a
+ * single pass and without regard to the locale. On success pos is left after
+ * the unit.
+ *
+ * The unit is a run of letters, looked up in units (case-insensitively if
+ * ignoreCase); a number without one is taken to be in defaultScale, or is
+ * rejected if that is 0. The result must be a whole multiple of the base unit,
+ * and at most max.
+ *
+ * Returns NULL, or what's wrong.
+ */
+static const char* scaledNumber(const string& s, size_t& pos, const Unit* units, size_t unitCount,
+		bool ignoreCase, uint64_t defaultScale, uint64_t max, uint64_t& result)
+{
+	uint64_t mantissa = 0;
+	int digits = 0, fraction = 0;
+	bool point = false;
+
+	for(; pos < s.length(); pos++) {
+		char c = s[pos];
+		if(c == '.' && !point) {
+			point = true;
+			continue;
+		}
+		if(c < '0' || c > '9') break;
+
+		digits++;
+		if(mulOverflows(mantissa, 10, mantissa) || addOverflows(mantissa, c - '0', mantissa)) {
+			return "value is too large";
+		}
+		if(point && ++fraction > 19) return "too many digits";
+	}
+	if(digits == 0) return "expected a number";
+
+	size_t start = pos;
+	while(pos < s.length() && ((s[pos] >= 'a' && s[pos] <= 'z') || (s[pos] >= 'A' && s[pos] <= 'Z'))) pos++;
+
+	uint64_t scale = defaultScale;
+	if(pos > start) {
+		scale = 0;
+		for(size_t u = 0; u < unitCount && !scale; u++) {
+			const char* name = units[u].name;
+			size_t i = 0;
+			for(; start + i < pos && name[i]; i++) {
+				char c = ignoreCase ? lower(s[start + i]) : s[start + i];
+				if(c != name[i]) break;
+			}
+			if(start + i == pos && !name[i]) scale = units[u].scale;
+		}
+		if(!scale) return "unknown unit";
+	} else if(!scale) {
+		return "expected a unit";
+	}
+
+	/* mantissa * scale / 10^fraction, without a wider type: with the common
+	 * factor taken out of scale and divisor, the divisor must divide the mantissa */
+	uint64_t common = gcd(scale, powersOfTen[fraction]);
+	uint64_t divisor = powersOfTen[fraction] / common, value;
+	if(mantissa % divisor) return "fraction is too small";
+	if(mulOverflows(mantissa / divisor, scale / common, value) || value > max) return "value is too large";
+	result = value;
+	return NULL;
+}
+
+/* Write value with the largest unit of units (sorted largest first) it is a multiple of */
+static void formatScaled(uint64_t value, const Unit* units, size_t unitCount, string& out) {
+	size_t u = 0;
+	while(value && u + 1 < unitCount && value % units[u].scale) u++;
+
+	char buf[32];
+	out.append(buf, snprintf(buf, sizeof(buf), "%llu", (unsigned long long) (value ? value / units[u].scale : 0)));
+	if(value) out += units[u].name;
+}
+
+/*
+ *
+ * Sizes
+ *
+ *
+ */
+
+bool ValueParser<ByteSize>::parse(const string &s, ByteSize& value, string& message)
+{
+	size_t pos = 0;
+	uint64_t bytes;
+
+	const char* error = scaledNumber(s, pos, sizeUnits, sizeof(sizeUnits) / sizeof(*sizeUnits),
+			true, 1, UINT64_MAX, bytes);
+	if(!error && pos != s.length()) error = "unexpected characters after the size";
+	if(error) {
+		message = string("Expected a size (e.g. 4G): ") + error;
+		return false;
+	}
+
+	value = ByteSize(bytes);
+	return true;
+}
+
+template<>
+bool PODParameter<ByteSize>::formatArgument(string& out) const {
+	if(!isSet()) return false;
+
+	static const Unit units[] = {
+		{ "E", 1ULL << 60 }, { "P", 1ULL << 50 }, { "T", 1ULL << 40 }, { "G", 1ULL << 30 },
+		{ "M", 1ULL << 20 }, { "K", 1ULL << 10 }, { "", 1ULL }
+	};
+	formatScaled(value.bytes(), units, sizeof(units) / sizeof(*units), out);
+	return true;
+}
+
+/*
+ *
+ * Durations
+ *
+ *
+ */
+
+bool ValueParser<std::chrono::nanoseconds>::parse(const string &s, std::chrono::nanoseconds& value, string& message)
+{
+	size_t pos = 0;
+	uint64_t total = 0;
+	const char* error = NULL;
+
+	/* A bare 0 needs no unit */
+	if(s == "0") {
+		value = std::chrono::nanoseconds(0);
+		return true;
+	}
+
+	while(!error && pos < s.length()) {
+		uint64_t part;
+		error = scaledNumber(s, pos, durationUnits, sizeof(durationUnits) / sizeof(*durationUnits),
+				false, 0, INT64_MAX - total, part);
+		total += part;
+	}
+	if(!error && s.empty()) error = "expected a number";
+	if(error) {
+		message = string("Expected a duration (e.g. 250ms or 1h30m): ") + error;
+		return false;
+	}
+
+	value = std::chrono::nanoseconds(total);
+	return true;
+}
+
+template<>
+bool PODParameter<std::chrono::nanoseconds>::formatArgument(string& out) const {
+	if(!isSet()) return false;
+
+	formatScaled(value.count(), durationUnits, sizeof(durationUnits) / sizeof(*durationUnits), out);
+	return true;
+}
+
+/*
+ *
+ * Class RangeSet
+ *
+ *
+ */
+
+RangeSet::RangeSet() {}
+
+RangeSet::RangeSet(const vector<Interval>& intervals) : fintervals(intervals) {
+	rebuild();
+}
+
+void RangeSet::add(uint32_t first, uint32_t last) {
+	if(first > last) swap(first, last);
+
+	/* The intervals overlapping or touching the new one are merged into it */
+	vector<Interval>::iterator from = lower_bound(fintervals.begin(), fintervals.end(), first,
+			[](const Interval& i, uint32_t n) { return (uint64_t) i.second + 1 < n; });
+	vector<Interval>::iterator to = from;
+	for(; to != fintervals.end() && to->first <= (uint64_t) last + 1; to++) {
+		first = std::min(first, to->first);
+		last = std::max(last, to->second);
+	}
+
+	if(from == to) {
+		fintervals.insert(from, make_pair(first, last));
+	} else {
+		*from = make_pair(first, last);
+		fintervals.erase(from + 1, to);
+	}
+
+	if(fintervals.back().second >= BITMAP_LIMIT) {
+		fbits.clear();
+		return;
+	}
+	if(fbits.size() <= last / 64) fbits.resize(last / 64 + 1, 0);
+	mark(first, last);
+}
+
+/* Sort and merge the intervals, and build the bitmap if the members are small enough */
+void RangeSet::rebuild() {
+	sort(fintervals.begin(), fintervals.end());
+
+	size_t n = 0;
+	for(size_t i = 0; i < fintervals.size(); i++) {
+		if(n && (uint64_t) fintervals[i].first <= (uint64_t) fintervals[n-1].second + 1) {
+			fintervals[n-1].second = std::max(fintervals[n-1].second, fintervals[i].second);
+		} else {
+			fintervals[n++] = fintervals[i];
+		}
+	}
+	fintervals.resize(n);
+
+	fbits.clear();
+	if(fintervals.empty() || fintervals.back().second >= BITMAP_LIMIT) return;
+
+	fbits.assign(fintervals.back().second / 64 + 1, 0);
+	for(size_t i = 0; i < fintervals.size(); i++) mark(fintervals[i].first, fintervals[i].second);
+}
+
+/* Set the bits first to last, whole words at a time where possible */
+void RangeSet::mark(uint32_t first, uint32_t last) {
+	while(first <= last) {
+		if(first % 64 == 0 && last - first >= 63) {
+			fbits[first / 64] = ~0ULL;
+			first += 64;
+		} else {
+			fbits[first / 64] |= 1ULL << (first % 64);
+			first++;
+		}
+	}
+}
+
+bool RangeSet::contains(uint32_t n) const {
+	if(!fbits.empty() || fintervals.empty()) {
+		return n / 64 < fbits.size() && ((fbits[n / 64] >> (n % 64)) & 1);
+	}
+
+	vector<Interval>::const_iterator i = upper_bound(fintervals.begin(), fintervals.end(),
+			make_pair(n, UINT32_MAX));
+	return i != fintervals.begin() && (i-1)->second >= n;
+}
+
+bool RangeSet::empty() const { return fintervals.empty(); }
+
+uint64_t RangeSet::count() const {
+	uint64_t n = 0;
+	for(size_t i = 0; i < fintervals.size(); i++) n += (uint64_t) fintervals[i].second - fintervals[i].first + 1;
+	return n;
+}
+
+const vector<RangeSet::Interval>& RangeSet::intervals() const { return fintervals; }
+
+size_t RangeSet::memoryUsage() const {
+	return fintervals.capacity() * sizeof(Interval) + fbits.capacity() * sizeof(uint64_t);
+}
+
+bool RangeSet::operator==(const RangeSet& other) const {
+	return fintervals == other.fintervals;
+}
+
+void ValueCodec<RangeSet>::encode(const RangeSet& value, string& out) {
+	const vector<RangeSet::Interval>& intervals = value.intervals();
+	for(size_t i = 0; i < intervals.size(); i++) {
+		out.append((const char*) &intervals[i].first, sizeof(uint32_t));
+		out.append((const char*) &intervals[i].second, sizeof(uint32_t));
+	}
+}
+
+size_t ValueCodec<RangeSet>::heapBytes(const RangeSet& value) {
+	return value.memoryUsage();
+}
+
+bool ValueCodec<RangeSet>::decode(const char* data, size_t length, RangeSet& value) {
+	if(length % (2 * sizeof(uint32_t))) return false;
+
+	vector<RangeSet::Interval> intervals(length / (2 * sizeof(uint32_t)));
+	for(size_t i = 0; i < intervals.size(); i++) {
+		memcpy(&intervals[i].first, data + 8*i, sizeof(uint32_t));
+		memcpy(&intervals[i].second, data + 8*i + 4, sizeof(uint32_t));
+	}
+	value = RangeSet(intervals);
+	return true;
+}
+
+bool ValueParser<RangeSet>::parse(const string &s, RangeSet& value, string& message)
+{
+	vector<RangeSet::Interval> intervals;
+	size_t pos = 0;
+	const char* error = NULL;
+
+	/* scaledNumber() would take 2.0 as 2 */
+	if(s.find('.') != string::npos) error = "ranges take integers";
+
+	while(!error) {
+		uint64_t first, last;
+
+		error = scaledNumber(s, pos, NULL, 0, false, 1, UINT32_MAX, first);
+		last = first;
+		if(!error && pos < s.length() && s[pos] == '-') {
+			pos++;
+			error = scaledNumber(s, pos, NULL, 0, false, 1, UINT32_MAX, last);
+			if(!error && last < first) error = "range ends before it starts";
+		}
+		if(error) break;
+
+		intervals.push_back(make_pair((uint32_t) first, (uint32_t) last));
+
+		if(pos == s.length()) break;
+		if(s[pos] != ',') error = "expected ',' or '-'";
+		pos++;
+	}
+	if(error) {
+		message = string("Expected a list of ranges (e.g. 0-31,64-95): ") + error;
+		return false;
+	}
+
+	value = RangeSet(intervals);
+	return true;
+}
+
+template<>
+bool PODParameter<RangeSet>::formatArgument(string& out) const {
+	if(!isSet()) return false;
+
+	const vector<RangeSet::Interval>& intervals = value.intervals();
+	for(size_t i = 0; i < intervals.size(); i++) {
+		char buf[32];
+		if(intervals[i].first == intervals[i].second) {
+			out.append(buf, snprintf(buf, sizeof(buf), "%s%u", i ? "," : "", intervals[i].first));
+		} else {
+			out.append(buf, snprintf(buf, sizeof(buf), "%s%u-%u", i ? "," : "", intervals[i].first, intervals[i].second));
+		}
+	}
+	return true;
+}
+
+template<>
+const char* PODParameter<ByteSize>::typeName() const { return "size"; }
+
+template<>
+const char* PODParameter<std::chrono::nanoseconds>::typeName() const { return "duration"; }
+
+template<>
+const char* PODParameter<RangeSet>::typeName() const { return "ranges"; }
+
+} //namespace
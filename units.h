@@ -0,0 +1,168 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "getoptpp.h"
+#include <chrono>
+
+#ifndef GETOPTPP_UNITS_H
+#define GETOPTPP_UNITS_H
+
+/* Value types with units: sizes, durations and sets of ranges */
+
+namespace vlofgren {
+
+/** A number of bytes, the value of a SizeParameter */
+class GETOPTPP_API ByteSize {
+public:
+	ByteSize(uint64_t bytes = 0) : fbytes(bytes) {}
+
+	uint64_t bytes() const { return fbytes; }
+	operator uint64_t() const { return fbytes; }
+private:
+	uint64_t fbytes;
+};
+
+/** A set of non-negative integers (e.g. CPU numbers), the value of a RangeSetParameter
+ *
+ * The set is kept as a sorted list of disjoint intervals, plus a bitmap when
+ * every member is below BITMAP_LIMIT, so that contains() is a single bit test
+ * for the typical CPU or node mask, and a binary search otherwise.
+ */
+class GETOPTPP_API RangeSet {
+public:
+	/** An interval of members, both ends included */
+	typedef pair<uint32_t, uint32_t> Interval;
+
+	static const uint32_t BITMAP_LIMIT = 65536;
+
+	RangeSet();
+
+	/** A set of the members of the intervals, which may overlap and come in any order */
+	RangeSet(const vector<Interval>& intervals);
+
+	/** Add the members first to last (inclusive) */
+	void add(uint32_t first, uint32_t last);
+
+	bool contains(uint32_t n) const;
+	bool empty() const;
+
+	/** Number of members */
+	uint64_t count() const;
+
+	/** The members, as sorted, disjoint and non-adjacent intervals */
+	const vector<Interval>& intervals() const;
+
+	/** Bytes held on the heap */
+	size_t memoryUsage() const;
+
+	bool operator==(const RangeSet& other) const;
+private:
+	void rebuild();
+	void mark(uint32_t first, uint32_t last);
+
+	vector<Interval> fintervals;
+	vector<uint64_t> fbits;
+};
+
+/* Saved as the underlying count, which the generic ValueCodec handles */
+template<>
+struct ValueCodec<ByteSize> {
+	static const bool supported = true;
+
+	static void encode(const ByteSize& value, string& out) {
+		ValueCodec<uint64_t>::encode(value.bytes(), out);
+	}
+
+	static bool decode(const char* data, size_t length, ByteSize& value) {
+		uint64_t bytes;
+		if(!ValueCodec<uint64_t>::decode(data, length, bytes)) return false;
+		value = ByteSize(bytes);
+		return true;
+	}
+
+	static size_t heapBytes(const ByteSize&) { return 0; }
+};
+
+template<>
+struct ValueCodec<std::chrono::nanoseconds> {
+	static const bool supported = true;
+	typedef std::chrono::nanoseconds::rep Rep;
+
+	static void encode(const std::chrono::nanoseconds& value, string& out) {
+		ValueCodec<Rep>::encode(value.count(), out);
+	}
+
+	static bool decode(const char* data, size_t length, std::chrono::nanoseconds& value) {
+		Rep count;
+		if(!ValueCodec<Rep>::decode(data, length, count)) return false;
+		value = std::chrono::nanoseconds(count);
+		return true;
+	}
+
+	static size_t heapBytes(const std::chrono::nanoseconds&) { return 0; }
+};
+
+template<>
+struct GETOPTPP_API ValueCodec<RangeSet> {
+	static const bool supported = true;
+
+	static void encode(const RangeSet& value, string& out);
+	static bool decode(const char* data, size_t length, RangeSet& value);
+	static size_t heapBytes(const RangeSet& value);
+};
+
+template<>
+struct GETOPTPP_API ValueParser<ByteSize> {
+	static const bool supported = true;
+	static bool parse(const string& s, ByteSize& value, string& error);
+};
+
+template<>
+struct GETOPTPP_API ValueParser<std::chrono::nanoseconds> {
+	static const bool supported = true;
+	static bool parse(const string& s, std::chrono::nanoseconds& value, string& error);
+};
+
+template<>
+struct GETOPTPP_API ValueParser<RangeSet> {
+	static const bool supported = true;
+	static bool parse(const string& s, RangeSet& value, string& error);
+};
+
+/** Parameter taking a size in bytes, with an optional binary unit:
+ * B, K, M, G, T, P or E (as in 4G, 512KiB or 1.5m; case doesn't matter,
+ * and a trailing B or iB is allowed). */
+typedef PODParameter<ByteSize> SizeParameter;
+
+/** Parameter taking a duration, as a sequence of numbers with units:
+ * ns, us, ms, s, m, h and d (as in 250ms, 1.5s or 1h30m). */
+typedef PODParameter<std::chrono::nanoseconds> DurationParameter;
+
+/** Parameter taking a set of integers, as a list of numbers and ranges, e.g. 0-31,64-95 */
+typedef PODParameter<RangeSet> RangeSetParameter;
+
+template<> bool PODParameter<ByteSize>::formatArgument(string& out) const;
+template<> bool PODParameter<std::chrono::nanoseconds>::formatArgument(string& out) const;
+template<> bool PODParameter<RangeSet>::formatArgument(string& out) const;
+template<> const char* PODParameter<ByteSize>::typeName() const;
+template<> const char* PODParameter<std::chrono::nanoseconds>::typeName() const;
+template<> const char* PODParameter<RangeSet>::typeName() const;
+
+} //namespace
+
+#endif
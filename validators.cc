@@ -0,0 +1,388 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+
+#include "validators.h"
+#include <cstring>
+#include <cstdio>
+
+/* SSE2 is part of every x86-64 CPU; AVX2 is used when the CPU has it,
+ * whatever the flags the library was compiled with */
+#if defined(__SSE2__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GETOPTPP_SPAN_X86
+#include <immintrin.h>
+#endif
+
+namespace vlofgren {
+
+/*
+ *
+ * Class CharClass
+ *
+ *
+ */
+
+CharClass::CharClass() : franges(0) {
+	memset(fbits, 0, sizeof(fbits));
+}
+
+CharClass::CharClass(const char* spec) : franges(0) {
+	memset(fbits, 0, sizeof(fbits));
+
+	size_t length = strlen(spec);
+	for(size_t i = 0; i < length; i++) {
+		if(i + 2 < length && spec[i+1] == '-') {
+			add(spec[i], spec[i+2]);
+			i += 2;
+		} else add(spec[i]);
+	}
+}
+
+CharClass& CharClass::add(unsigned char c) {
+	return add(c, c);
+}
+
+CharClass& CharClass::add(unsigned char first, unsigned char last) {
+	for(unsigned c = first; c <= last; c++) fbits[c >> 6] |= 1ULL << (c & 63);
+	updateRanges();
+	return *this;
+}
+
+CharClass& CharClass::add(const CharClass& other) {
+	for(int i = 0; i < 4; i++) fbits[i] |= other.fbits[i];
+	updateRanges();
+	return *this;
+}
+
+CharClass& CharClass::invert() {
+	for(int i = 0; i < 4; i++) fbits[i] = ~fbits[i];
+	updateRanges();
+	return *this;
+}
+
+bool CharClass::contains(unsigned char c) const {
+	return (fbits[c >> 6] >> (c & 63)) & 1;
+}
+
+/* Recompute the range list from the bitmap; franges > MAX_RANGES means
+ * there are too many ranges for the vectorized span() */
+void CharClass::updateRanges() {
+	franges = 0;
+	for(unsigned c = 0; c < 256; ) {
+		if(!contains(c)) { c++; continue; }
+
+		unsigned last = c;
+		while(last + 1 < 256 && contains(last + 1)) last++;
+
+		if(franges < MAX_RANGES) {
+			ffirst[franges] = c;
+			flast[franges] = last;
+		}
+		franges++;
+		c = last + 1;
+	}
+}
+
+#ifdef GETOPTPP_SPAN_X86
+/* A character c is in the range [first, last] iff (unsigned char) (c - first)
+ * <= last - first, which is what the min/cmpeq pairs test. Both return where
+ * they stopped: at the first character not in the set, or before the tail
+ * too short for a whole vector.
+ */
+static size_t spanSSE2(const unsigned char* ffirst, const unsigned char* flast, unsigned ranges,
+		const char* s, size_t length) {
+	__m128i first[CharClass::MAX_RANGES], width[CharClass::MAX_RANGES];
+	for(unsigned r = 0; r < ranges; r++) {
+		first[r] = _mm_set1_epi8(ffirst[r]);
+		width[r] = _mm_set1_epi8(flast[r] - ffirst[r]);
+	}
+
+	size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*) (s + i));
+		__m128i in = _mm_setzero_si128();
+		for(unsigned r = 0; r < ranges; r++) {
+			__m128i d = _mm_sub_epi8(v, first[r]);
+			in = _mm_or_si128(in, _mm_cmpeq_epi8(_mm_min_epu8(d, width[r]), d));
+		}
+
+		unsigned mask = _mm_movemask_epi8(in);
+		if(mask != 0xFFFF) return i + __builtin_ctz(~mask);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t spanAVX2(const unsigned char* ffirst, const unsigned char* flast, unsigned ranges,
+		const char* s, size_t length) {
+	__m256i first[CharClass::MAX_RANGES], width[CharClass::MAX_RANGES];
+	for(unsigned r = 0; r < ranges; r++) {
+		first[r] = _mm256_set1_epi8(ffirst[r]);
+		width[r] = _mm256_set1_epi8(flast[r] - ffirst[r]);
+	}
+
+	size_t i = 0;
+	for(; i + 32 <= length; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) (s + i));
+		__m256i in = _mm256_setzero_si256();
+		for(unsigned r = 0; r < ranges; r++) {
+			__m256i d = _mm256_sub_epi8(v, first[r]);
+			in = _mm256_or_si256(in, _mm256_cmpeq_epi8(_mm256_min_epu8(d, width[r]), d));
+		}
+
+		uint32_t mask = _mm256_movemask_epi8(in);
+		if(mask != 0xFFFFFFFFU) return i + __builtin_ctz(~mask);
+	}
+	return i;
+}
+
+static bool haveAVX2() {
+	static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+	return avx2;
+}
+#endif
+
+size_t CharClass::span(const char* s, size_t length) const {
+	size_t i = 0;
+
+#ifdef GETOPTPP_SPAN_X86
+	if(franges <= MAX_RANGES) {
+		if(haveAVX2()) i = spanAVX2(ffirst, flast, franges, s, length);
+		else i = spanSSE2(ffirst, flast, franges, s, length);
+	}
+#endif
+
+	for(; i < length; i++) {
+		if(!contains(s[i])) return i;
+	}
+	return length;
+}
+
+CharClass CharClass::alpha() { return CharClass("a-zA-Z"); }
+CharClass CharClass::digit() { return CharClass("0-9"); }
+CharClass CharClass::alnum() { return CharClass("a-zA-Z0-9"); }
+CharClass CharClass::hex() { return CharClass("0-9a-fA-F"); }
+CharClass CharClass::base64() { return CharClass("A-Za-z0-9+/="); }
+CharClass CharClass::identifier() { return CharClass("a-zA-Z0-9_"); }
+CharClass CharClass::any() { return CharClass().invert(); }
+
+/*
+ *
+ * Class StringPattern
+ *
+ *
+ */
+
+static CharClass escapeClass(char c) {
+	switch(c) {
+	case 'd': return CharClass::digit();
+	case 'w': return CharClass::identifier();
+	case 's': return CharClass(" \t\n\r\f\v");
+	default: return CharClass().add(c);
+	}
+}
+
+static size_t parseCount(const char* &p) {
+	if(*p < '0' || *p > '9') throw logic_error("StringPattern: expected a number in {}");
+
+	size_t n = 0;
+	for(; *p >= '0' && *p <= '9'; p++) n = n*10 + (*p - '0');
+	return n;
+}
+
+StringPattern::StringPattern(const char* pattern) : fsource(pattern) {
+	const char* p = pattern;
+
+	while(*p) {
+		Element e;
+
+		if(*p == '\\') {
+			if(!p[1]) throw logic_error("StringPattern: trailing \\ in " + fsource);
+			e.characters = escapeClass(p[1]);
+			p += 2;
+		} else if(*p == '.') {
+			e.characters = CharClass::any();
+			p++;
+		} else if(*p == '[') {
+			p++;
+			bool negate = (*p == '^');
+			if(negate) p++;
+
+			/* A ']' right after the opening bracket is a literal */
+			const char* start = p;
+			while(*p && (*p != ']' || p == start)) {
+				if(*p == '\\' && p[1]) {
+					e.characters.add(escapeClass(p[1]));
+					p += 2;
+				} else if(p[1] == '-' && p[2] && p[2] != ']') {
+					e.characters.add(p[0], p[2]);
+					p += 3;
+				} else e.characters.add(*p++);
+			}
+			if(*p != ']') throw logic_error("StringPattern: unterminated [ in " + fsource);
+			p++;
+
+			if(negate) e.characters.invert();
+		} else {
+			e.characters.add(*p++);
+		}
+
+		e.min = e.max = 1;
+		switch(*p) {
+		case '?': e.min = 0; p++; break;
+		case '*': e.min = 0; e.max = string::npos; p++; break;
+		case '+': e.max = string::npos; p++; break;
+		case '{':
+			p++;
+			e.min = e.max = parseCount(p);
+			if(*p == ',') {
+				p++;
+				e.max = (*p == '}') ? string::npos : parseCount(p);
+			}
+			if(*p != '}' || e.max < e.min) throw logic_error("StringPattern: malformed {} in " + fsource);
+			p++;
+			break;
+		}
+
+		felements.push_back(e);
+	}
+}
+
+size_t StringPattern::mismatch(const char* s, size_t length) const {
+	size_t pos = 0;
+
+	for(vector<Element>::const_iterator e = felements.begin(); e != felements.end(); e++) {
+		size_t limit = length - pos;
+		if(e->max < limit) limit = e->max;
+
+		size_t n = e->characters.span(s + pos, limit);
+		pos += n;
+
+		if(n < e->min) return pos;
+	}
+
+	return pos == length ? string::npos : pos;
+}
+
+const string& StringPattern::source() const { return fsource; }
+
+/*
+ *
+ * Class StringValidator
+ *
+ *
+ */
+
+StringValidator::StringValidator() : fminLength(0), fmaxLength(string::npos),
+	fcheckCharacters(false), fcheckPattern(false) {}
+
+StringValidator& StringValidator::length(size_t min, size_t max) {
+	fminLength = min;
+	fmaxLength = max;
+	return *this;
+}
+
+StringValidator& StringValidator::characters(const CharClass& allowed) {
+	fcharacters = allowed;
+	fcheckCharacters = true;
+	return *this;
+}
+
+StringValidator& StringValidator::pattern(const StringPattern& pattern) {
+	fpattern.assign(1, pattern);
+	fcheckPattern = true;
+	return *this;
+}
+
+/* Describe the character at s[offset], or the end of the string */
+static string describe(const string& s, size_t offset) {
+	if(offset >= s.length()) return "unexpected end of argument";
+
+	unsigned char c = s[offset];
+	char buf[64];
+	if(c >= 0x20 && c < 0x7f) snprintf(buf, sizeof(buf), "invalid character '%c' at offset %lu", c, (unsigned long) offset);
+	else snprintf(buf, sizeof(buf), "invalid character 0x%02x at offset %lu", c, (unsigned long) offset);
+	return buf;
+}
+
+void StringValidator::check(const string& s) const GETOPTPP_THROW(StringValidator::InvalidString) {
+	string error;
+	size_t offset = find(s, error);
+	if(offset != string::npos) throw InvalidString(error, offset);
+}
+
+size_t StringValidator::find(const string& s, string& error) const {
+	if(s.length() < fminLength || s.length() > fmaxLength) {
+		char buf[96];
+		if(fmaxLength == string::npos) {
+			snprintf(buf, sizeof(buf), "expected at least %lu characters, got %lu",
+					(unsigned long) fminLength, (unsigned long) s.length());
+		} else {
+			snprintf(buf, sizeof(buf), "expected %lu to %lu characters, got %lu",
+					(unsigned long) fminLength, (unsigned long) fmaxLength, (unsigned long) s.length());
+		}
+		error = buf;
+		return s.length() < fminLength ? s.length() : fmaxLength;
+	}
+
+	if(fcheckCharacters) {
+		size_t n = fcharacters.span(s.data(), s.length());
+		if(n != s.length()) {
+			error = describe(s, n);
+			return n;
+		}
+	}
+
+	if(fcheckPattern) {
+		size_t n = fpattern[0].mismatch(s.data(), s.length());
+		if(n != string::npos) {
+			error = describe(s, n) + " (expected " + fpattern[0].source() + ")";
+			return n;
+		}
+	}
+
+	return string::npos;
+}
+
+/*
+ *
+ * Class ValidatedStringParameter
+ *
+ *
+ */
+
+ValidatedStringParameter::ValidatedStringParameter(char shortOption, const char *longOption,
+		const char* description) : StringParameter(shortOption, longOption, description) {}
+ValidatedStringParameter::~ValidatedStringParameter() {}
+
+StringValidator& ValidatedStringParameter::validator() { return fvalidator; }
+
+string ValidatedStringParameter::validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected) {
+	fvalidator.check(s);
+	return s;
+}
+
+bool ValidatedStringParameter::tryValidate(const string& s, string& value, string& error) {
+	if(!validatesAs<ValidatedStringParameter>()) return catchValidate(s, value, error);
+
+	if(fvalidator.find(s, error) != string::npos) return false;
+	value = s;
+	return true;
+}
+
+} //namespace
@@ -0,0 +1,172 @@
+ /* (C) 2011 Viktor Lofgren
+  *
+  *  This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+
+#include "getoptpp.h"
+
+#ifndef GETOPTPP_VALIDATORS_H
+#define GETOPTPP_VALIDATORS_H
+
+namespace vlofgren {
+
+/** A set of characters, e.g. [a-zA-Z0-9_].
+ *
+ * Besides the 256-bit membership table, the set is kept as a list of ranges
+ * when it has few enough of them, which lets span() test 16 (SSE2) or 32 (AVX2,
+ * picked at run time) characters per step. Sets with many ranges fall back to
+ * the table.
+ */
+class GETOPTPP_API CharClass {
+public:
+	/** An empty set */
+	CharClass();
+
+	/** A set given as a list of characters and ranges, e.g. "a-zA-Z0-9_".
+	 *
+	 * A '-' at either end of the list stands for itself.
+	 */
+	CharClass(const char* spec);
+
+	CharClass& add(unsigned char c);
+	CharClass& add(unsigned char first, unsigned char last);
+	CharClass& add(const CharClass& other);
+
+	/** Replace the set by its complement */
+	CharClass& invert();
+
+	bool contains(unsigned char c) const;
+
+	/** Length of the longest prefix of s[0, length) whose characters are all in the set */
+	size_t span(const char* s, size_t length) const;
+
+	static CharClass alpha();
+	static CharClass digit();
+	static CharClass alnum();
+	static CharClass hex();
+	static CharClass base64();
+	/** [a-zA-Z0-9_] */
+	static CharClass identifier();
+	/** Every character */
+	static CharClass any();
+
+	/** Upper bound on the number of ranges the vectorized span() handles */
+	static const unsigned MAX_RANGES = 8;
+private:
+	void updateRanges();
+
+	uint64_t fbits[4];
+	unsigned char ffirst[MAX_RANGES], flast[MAX_RANGES];
+	unsigned franges;
+};
+
+/** An anchored pattern of character classes, e.g. "0x[0-9a-f]{1,16}".
+ *
+ * The syntax is a small subset of regular expressions: literal characters,
+ * '.', classes ([...] and [^...]), the escapes \d, \w, \s and \c (for a literal c),
+ * and the quantifiers ?, *, +, {n}, {n,} and {n,m}.
+ *
+ * Quantifiers are possessive: each element takes as many characters as it can,
+ * and never gives any back. This keeps matching linear (and vectorized), and is
+ * what one wants for formats like the one above, but a pattern such as "a*a"
+ * can never match.
+ */
+class GETOPTPP_API StringPattern {
+public:
+	/** @throw logic_error if the pattern is malformed */
+	StringPattern(const char* pattern);
+
+	/** Match the pattern against all of s[0, length).
+	 *
+	 * @return string::npos if s matches, or else the offset where it stops matching.
+	 */
+	size_t mismatch(const char* s, size_t length) const;
+
+	const string& source() const;
+private:
+	struct Element {
+		CharClass characters;
+		size_t min, max;
+	};
+
+	vector<Element> felements;
+	string fsource;
+};
+
+/** Reusable check of a string's length, characters and format.
+ *
+ * Each check is optional; the ones set are applied in that order.
+ */
+class GETOPTPP_API StringValidator {
+public:
+
+	/** Exception thrown by check(), which knows where in the string things went wrong */
+	class InvalidString : public Parameter::ParameterRejected {
+	public:
+		InvalidString(const string& s, size_t offset) : ParameterRejected(s), foffset(offset) {}
+
+		virtual void rethrow(const string& s) const { throw InvalidString(s, foffset); }
+
+		/** Offset of the offending character (the string's length if it ended too soon) */
+		size_t offset() const { return foffset; }
+	private:
+		size_t foffset;
+	};
+
+	StringValidator();
+
+	StringValidator& length(size_t min, size_t max = string::npos);
+	StringValidator& characters(const CharClass& allowed);
+	StringValidator& pattern(const StringPattern& pattern);
+
+	/** @throw InvalidString if s does not pass the checks */
+	void check(const string& s) const GETOPTPP_THROW(InvalidString);
+
+	/** check() without throwing
+	 *
+	 * @return string::npos if s passes the checks, or else the offset
+	 * 			InvalidString would have, with its message in error
+	 */
+	size_t find(const string& s, string& error) const;
+private:
+	size_t fminLength, fmaxLength;
+	bool fcheckCharacters, fcheckPattern;
+	CharClass fcharacters;
+	vector<StringPattern> fpattern;
+};
+
+/** String parameter whose argument is checked by a StringValidator
+ *
+ *	ps.add<ValidatedStringParameter>('k', "key", "Hex encoded key")
+ *		.validator().pattern("[0-9a-fA-F]{64}");
+ */
+class GETOPTPP_API ValidatedStringParameter : public StringParameter {
+public:
+	ValidatedStringParameter(char shortOption, const char *longOption,
+			const char* description);
+	virtual ~ValidatedStringParameter();
+
+	StringValidator& validator();
+protected:
+	virtual string validate(const string& s) GETOPTPP_THROW(Parameter::ParameterRejected);
+	virtual bool tryValidate(const string& s, string& value, string& error);
+
+	StringValidator fvalidator;
+};
+
+} //namespace
+
+#endif